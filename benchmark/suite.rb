@@ -0,0 +1,221 @@
+# Benchmark suite of Racc: the time spent in each phase of compiling the
+# grammars in test/assets and sample, the size of their tables, and the
+# throughput of the C and Ruby runtimes on random sentences of each
+# grammar, the Ruby one also with the parse loop of the ruby_parse_loop
+# option (rb_loop).  The results are written as JSON and may be compared
+# with a saved baseline; regressions make the exit status 1.
+#
+#   ruby -Ilib benchmark/suite.rb [options] [grammar.y ...]
+#
+# Run it as ruby --yjit (or RUBYOPT=--yjit rake bench) to measure the
+# runtimes under YJIT; the results tell whether it was enabled.
+#
+#   --output=FILE      write the results to FILE
+#   --baseline=FILE    compare the results with FILE
+#   --threshold=PCT    tolerated slowdown in percent [10]
+#   --repeat=N         best of N runs for each measurement [3]
+#   --length=N         tokens of the sentences parsed [10000]
+#
+# rake bench runs it with tmp/bench.json as output and
+# tmp/bench-baseline.json as baseline; rake bench:baseline saves one.
+
+require 'racc/static'
+require 'json'
+require 'optparse'
+require 'stringio'
+
+module RaccBench
+  COMPILE_PHASES = %w[parse nfa dfa table generation]
+  RUNTIMES = %w[c_do_parse rb_do_parse rb_loop c_yyparse rb_yyparse]
+
+  def self.clock
+    Process.clock_gettime(Process::CLOCK_MONOTONIC)
+  end
+
+  # Returns the least time of REPEAT runs of the block, and its result.
+  def self.best(repeat)
+    best = result = nil
+    repeat.times do
+      t = clock
+      result = yield
+      t = clock - t
+      best = t if best.nil? or t < best
+    end
+    [best, result]
+  end
+
+  def self.compile(path, repeat)
+    times = {}
+    result = states = table = source = nil
+    times['parse'], result = best(repeat) {
+      Racc::GrammarFileParser.new.parse(File.read(path), File.basename(path))
+    }
+    times['nfa'], states = best(repeat) { Racc::States.new(result.grammar).nfa }
+    times['dfa'] = Array.new(repeat) {
+      s = Racc::States.new(result.grammar).nfa
+      t = clock
+      s.dfa
+      clock - t
+    }.min
+    states.dfa
+    params = result.params.dup
+    params.filename = File.basename(path)
+    times['table'], table = best(repeat) {
+      Racc::StateTransitionTable.generate(states, **params.table_options)
+    }
+    states.state_transition_table(**params.table_options)
+    times['generation'], source = best(repeat) {
+      Racc::ParserFileGenerator.new(states, params).generate_parser
+    }
+    sizes = {
+      'states' => states.size,
+      'action_table' => table.action_table.size,
+      'goto_table' => table.goto_table.size,
+      'source' => source.bytesize
+    }
+    [result.grammar, states, times, sizes]
+  end
+
+  # The recognizer of STATES.  With PARSE_LOOP, it has the parse loop of
+  # the ruby_parse_loop option, which calls an action method for each
+  # rule with an action, as the generated parser would.
+  def self.recognizer(states, parse_loop = false)
+    c = Racc::SentenceGenerator.recognizer(states)
+    return c unless parse_loop
+    params = Racc::ParserFileGenerator::Params.new
+    params.result_var = false
+    src = StringIO.new
+    Racc::ParserFileGenerator.new(states, params).put_parse_loop(src)
+    c.class_eval src.string
+    states.state_transition_table.reduce_table.each_slice(3).map(&:last).uniq.each do |mid|
+      c.class_eval "def #{mid}(val, _values) val[0] end" unless mid == :_reduce_none
+    end
+    c
+  end
+
+  # Tokens per second of each runtime parsing a random sentence.
+  def self.throughput(grammar, states, length, repeat)
+    begin
+      generator = Racc::SentenceGenerator.new(grammar, random: Random.new(1))
+    rescue Racc::CompileError   # no sentence without the error token
+      return nil
+    end
+    sentence = generator.generate(length)
+    return nil if sentence.empty?
+    tokens = sentence.map {|sym| [sym.ident, nil] }.push([false, '$'])
+    parser = recognizer(states)
+    parsers = Hash.new(parser)
+    parsers['rb_loop'] = recognizer(states, true)
+    runs = {
+      'c_do_parse'  => ->(p) { p.__send__(:_racc_do_parse_c, p.__send__(:_racc_setup), false) },
+      'rb_do_parse' => ->(p) { p.__send__(:_racc_do_parse_rb, p.__send__(:_racc_setup), false) },
+      'rb_loop'     => ->(p) { p.__send__(:_racc_do_parse_rb, p.__send__(:_racc_setup), false) },
+      'c_yyparse'   => ->(p) { p.__send__(:_racc_yyparse_c, tokens, :each, p.__send__(:_racc_setup), false) },
+      'rb_yyparse'  => ->(p) { p.__send__(:_racc_yyparse_rb, tokens, :each, p.__send__(:_racc_setup), false) }
+    }
+    runs.reject! {|name, _| name.start_with?('c_') } unless Racc::Parser.racc_runtime_type == 'c'
+    begin
+      runs.first[1].call(parser.new(tokens))
+    rescue Racc::ParseError   # rejected where conflicts are resolved by nonassoc
+      return nil
+    end
+    result = {'tokens' => sentence.size}
+    runs.each do |name, run|
+      time, = best(repeat) { run.call(parsers[name].new(tokens)) }
+      result[name] = (sentence.size / time).round
+    end
+    result
+  end
+
+  # Returns the regressions of CURRENT from BASELINE, as messages.
+  def self.compare(baseline, current, threshold)
+    limit = 1 + threshold / 100.0
+    regressions = []
+    COMPILE_PHASES.each do |phase|
+      old = baseline['compile'].sum {|name, r| current['compile'][name] ? r['time'][phase] : 0 }
+      new = current['compile'].sum {|name, r| baseline['compile'][name] ? r['time'][phase] : 0 }
+      if new > old * limit
+        regressions.push format('compile %s: %.3fs -> %.3fs', phase, old, new)
+      end
+    end
+    current['compile'].each do |name, r|
+      next unless old = baseline['compile'][name]
+      r['size'].each do |key, n|
+        if old['size'][key] and n > old['size'][key]
+          regressions.push "#{name} #{key}: #{old['size'][key]} -> #{n}"
+        end
+      end
+    end
+    current['runtime'].each do |name, r|
+      next unless old = baseline['runtime'][name]
+      RUNTIMES.each do |rt|
+        next unless r[rt] and old[rt]
+        if r[rt] * limit < old[rt]
+          regressions.push "#{name} #{rt}: #{old[rt]} -> #{r[rt]} tokens/s"
+        end
+      end
+    end
+    regressions
+  end
+
+  def self.main(argv)
+    output = baseline = nil
+    threshold = 10.0
+    repeat = 3
+    length = 10_000
+    OptionParser.new do |opt|
+      opt.on('--output=FILE') {|f| output = f }
+      opt.on('--baseline=FILE') {|f| baseline = f }
+      opt.on('--threshold=PCT', Float) {|n| threshold = n }
+      opt.on('--repeat=N', Integer) {|n| repeat = n }
+      opt.on('--length=N', Integer) {|n| length = n }
+    end.parse!(argv)
+    root = File.expand_path('..', __dir__)
+    files = argv.empty? ? Dir.glob("#{root}/{test/assets,sample}/*.y").sort : argv
+
+    results = {
+      'ruby' => RUBY_DESCRIPTION,
+      'racc' => Racc::VERSION,
+      'runtime_type' => Racc::Parser.racc_runtime_type,
+      'yjit' => !!(defined?(RubyVM::YJIT) and RubyVM::YJIT.enabled?),
+      'length' => length,
+      'compile' => {},
+      'runtime' => {}
+    }
+    printf "%-36s %8s %8s %8s %8s %8s %7s  %s\n",
+           'grammar', *COMPILE_PHASES, 'states', 'tokens/s (' + RUNTIMES.join(' ') + ')'
+    files.each do |path|
+      name = path.sub("#{root}/", '')
+      begin
+        grammar, states, times, sizes = compile(path, repeat)
+      rescue StandardError, Racc::Error   # broken grammars used by the tests
+        next
+      end
+      results['compile'][name] = {'time' => times, 'size' => sizes}
+      tps = throughput(grammar, states, length, repeat)
+      results['runtime'][name] = tps if tps
+      printf "%-36s %s %7d  %s\n", name,
+             COMPILE_PHASES.map {|ph| format('%8.4f', times[ph]) }.join(' '),
+             sizes['states'], tps ? RUNTIMES.map {|rt| tps[rt] || '-' }.join(' ') : '-'
+    end
+
+    if output
+      dir = File.dirname(output)
+      Dir.mkdir dir unless File.directory?(dir)
+      File.write output, JSON.pretty_generate(results)
+      puts "results written to #{output}"
+    end
+    if baseline and File.exist?(baseline)
+      regressions = compare(JSON.parse(File.read(baseline)), results, threshold)
+      if regressions.empty?
+        puts "no regression from #{baseline}"
+      else
+        puts "regressions from #{baseline} (threshold #{threshold}%):"
+        regressions.each {|msg| puts "  #{msg}" }
+        exit 1
+      end
+    end
+  end
+end
+
+RaccBench.main(ARGV) if $0 == __FILE__
@@ -0,0 +1,55 @@
+# Compares the table packers of StateTransitionTableGenerator: the native
+# first-fit packer in cparse and the Regexp based one in Ruby.  Prints the
+# time spent generating the tables and the size of the packed tables.
+#
+#   ruby -Ilib benchmark/table_packing.rb [grammar.y ...]
+#
+# Without arguments all grammars in test/assets are used.
+
+require 'racc/static'
+require 'benchmark'
+
+abort 'cparse is not loaded' unless defined?(Racc::Cparse.pack_table)
+
+class RubyPacker < Racc::StateTransitionTableGenerator
+  def set_table(entries, dummy, tbl, chk, ptr, check_base = false)
+    entries.sort_by!.with_index {|a,i| [-a[0].size, i] }
+    set_table_rb entries, tbl, chk, ptr, check_base
+  end
+end
+
+def tables(t)
+  [t.action_table, t.action_check, t.action_pointer,
+   t.goto_table, t.goto_check, t.goto_pointer]
+end
+
+files = ARGV.empty? ? Dir.glob(File.expand_path('../test/assets/*.y', __dir__)).sort : ARGV
+
+total = [0.0, 0.0, 0]
+printf "%-24s %10s %10s %8s %8s\n", 'grammar', 'native (s)', 'ruby (s)', 'action', 'goto'
+files.each do |path|
+  begin
+    result = Racc::GrammarFileParser.new.parse(File.read(path), File.basename(path))
+    states = Racc::States.new(result.grammar).nfa
+    states.dfa
+  rescue StandardError   # broken grammars used by the tests
+    next
+  end
+  native = ruby = nil
+  native_time = Benchmark.realtime {
+    native = Racc::StateTransitionTableGenerator.new(states).generate
+  }
+  ruby_time = Benchmark.realtime {
+    ruby = RubyPacker.new(states).generate
+  }
+  unless tables(native) == tables(ruby)
+    abort "#{path}: the packers made different tables"
+  end
+  size = native.action_table.size + native.goto_table.size
+  total[0] += native_time
+  total[1] += ruby_time
+  total[2] += size
+  printf "%-24s %10.4f %10.4f %8d %8d\n", File.basename(path),
+         native_time, ruby_time, native.action_table.size, native.goto_table.size
+end
+printf "%-24s %10.4f %10.4f %17d\n", 'total', *total
@@ -10,6 +10,9 @@
 */
 
 #include <ruby.h>
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+#  include <ruby/ractor.h>
+#endif
 
 #ifndef FALSE
 #define FALSE 0
@@ -32,6 +35,10 @@
 #define vERROR_TOKEN    INT2FIX(ERROR_TOKEN)
 #define vFINAL_TOKEN    INT2FIX(FINAL_TOKEN)
 
+/* bits of Racc_rule_flags */
+#define RULE_USES_VALUES 0x01
+#define RULE_NO_JUMP     0x02
+
 /* -----------------------------------------------------------------------
                           File Local Variables
 ----------------------------------------------------------------------- */
@@ -39,11 +46,30 @@
 static VALUE RaccBug;
 static VALUE CparseParams;
 
+static ID id_tables;
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+static rb_ractor_local_key_t main_ractor_key;
+static rb_ractor_local_key_t ractor_tables_key;
+#endif
+static ID id_rule_flags;
+static ID id_native_stack;
+static ID id_positional_args;
+static ID id_shared_action_rows;
+static ID id_push_params;
+static ID id_params;
+static ID id_push;
+static ID id_unshift;
+
 static ID id_yydebug;
 static ID id_nexttoken;
 static ID id_onerror;
 static ID id_noreduce;
 static ID id_errstatus;
+static ID id_collect_stats;
+static ID id_statistics;
+static ID id_trace_size;
+static ID id_trace_data;
+static ID id_trace_count;
 
 static ID id_d_shift;
 static ID id_d_reduce;
@@ -70,6 +96,16 @@ static ID id_d_e_pop;
 #  define LONG2NUM(i) INT2NUM(i)
 #endif
 
+/* GC compaction (Ruby 2.7+) moves the objects marked movable and calls
+   the dcompact function to update the references to them. */
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+#  define GC_MARK_MOVABLE(v) rb_gc_mark_movable(v)
+#  define GC_LOCATION(v) rb_gc_location(v)
+#else
+#  define GC_MARK_MOVABLE(v) rb_gc_mark(v)
+#  define GC_LOCATION(v) (v)
+#endif
+
 static ID value_to_id(VALUE v);
 static inline long num_to_long(VALUE n);
 
@@ -116,18 +152,108 @@ cut_stack_tail(VALUE stack, long len)
 }
 
 #define STACK_INIT_LEN 64
+#define STACK_KEEP_LEN 4096   /* larger stacks are not kept for reuse */
 #define NEW_STACK() rb_ary_new2(STACK_INIT_LEN)
 #define PUSH(s, i) rb_ary_store(s, RARRAY_LEN(s), i)
 #define POP(s) rb_ary_pop(s)
-#define LAST_I(s) \
-    ((RARRAY_LEN(s) > 0) ? rb_ary_entry(s, RARRAY_LEN(s) - 1) : Qnil)
 #define GET_TAIL(s, len) get_stack_tail(s, len)
 #define CUT_TAIL(s, len) cut_stack_tail(s, len)
 
+/* -----------------------------------------------------------------------
+                        Packed Transition Tables
+----------------------------------------------------------------------- */
+
+/*
+   Racc_arg is converted once per parser class into plain C arrays.
+   Each table is stored as int16_t when all of its entries fit, int32_t
+   otherwise.  nil entries are replaced by the most negative value of
+   the element type, which table_ref() returns as TABLE_NIL.
+   A table may also be a String of little endian int32s, as written by
+   the packed_tables option, where INT32_MIN stands for nil.
+*/
+
+#define TABLE_NIL (-0x7fffffffL - 1)
+
+struct packed_table {
+    long len;
+    int  wide;             /* true if entries are int32_t */
+    void *ptr;
+};
+
+struct reduce_entry {
+    long len;              /* length of RHS */
+    long reduce_to;        /* LHS symbol */
+    ID   mid;              /* action method */
+    int  flags;            /* RULE_* bits */
+    int  builtin;          /* BUILTIN_* action run without calling mid */
+    long nth;              /* index of the value BUILTIN_VAL returns */
+};
+
+/* Built-in actions, named _racc_builtin_* in the reduce table.
+   _reduce_none is BUILTIN_VAL of the first value. */
+#define BUILTIN_VAL     1
+#define BUILTIN_NIL     2
+#define BUILTIN_ARRAY   3
+#define BUILTIN_APPEND  4
+#define BUILTIN_PREPEND 5
+
+struct cparse_tables {
+    VALUE arg;             /* Racc_arg this cache was built from */
+    VALUE token_table;     /* token conversion table */
+
+    /* action table */
+    struct packed_table action_table;
+    struct packed_table action_check;
+    struct packed_table action_default;
+    struct packed_table action_pointer;
+    /* goto table */
+    struct packed_table goto_table;
+    struct packed_table goto_check;
+    struct packed_table goto_default;
+    struct packed_table goto_pointer;
+
+    long nt_base;          /* NonTerminal BASE index */
+    long shift_n;
+    long reduce_n;
+
+    long nrules;
+    struct reduce_entry *rules;
+
+    int native_stack;      /* keep the value stack in a C array */
+    int positional_args;   /* pass RHS values as separate arguments */
+    int int_tokens;        /* Integer tokens are terminal ids */
+    int check_base;        /* action_check holds the row base, not the state */
+};
+
+/* The value action_check must hold for the current state, whose row
+   starts at BASE. */
+#define ACTION_CHECK_KEY(v, base) \
+    ((v)->tables->check_base ? (base) : (v)->curstate)
+
+static inline long
+table_ref(const struct packed_table *t, long idx)
+{
+    long n;
+
+    if (idx < 0 || idx >= t->len) return TABLE_NIL;
+    if (t->wide) {
+        n = ((const int32_t *)t->ptr)[idx];
+        return (n == INT32_MIN) ? TABLE_NIL : n;
+    }
+    else {
+        n = ((const int16_t *)t->ptr)[idx];
+        return (n == INT16_MIN) ? TABLE_NIL : n;
+    }
+}
+
+#define TREF(v, name, idx) table_ref(&(v)->tables->name, idx)
+
 /* -----------------------------------------------------------------------
                        struct cparse_params
 ----------------------------------------------------------------------- */
 
+/* The object is write barrier protected: set its VALUE members with
+   PARAMS_WRITE, and tell the GC of the values stored in vbuf. */
 struct cparse_params {
     VALUE value_v;         /* VALUE version of this struct */
 
@@ -137,31 +263,28 @@ struct cparse_params {
     VALUE lexer;           /* scanner object */
     ID    lexmid;          /* name of scanner method (must be an iterator) */
 
+    int   lex_from_buffer;
+    VALUE tok_types;       /* Array of tokens, or String of int32 ids */
+    VALUE tok_values;      /* Array of token values */
+    long  tok_pos;         /* index of the next token */
+
     /* State transition tables (immutable)
        Data structure is from Dragon Book 4.9 */
-    /* action table */
-    VALUE action_table;
-    VALUE action_check;
-    VALUE action_default;
-    VALUE action_pointer;
-    /* goto table */
-    VALUE goto_table;
-    VALUE goto_check;
-    VALUE goto_default;
-    VALUE goto_pointer;
-
-    long  nt_base;         /* NonTerminal BASE index */
-    VALUE reduce_table;    /* reduce data table */
-    VALUE token_table;     /* token conversion table */
+    VALUE tables_v;        /* VALUE version of tables */
+    const struct cparse_tables *tables;
 
     /* parser stacks and parameters */
-    VALUE state;
+    long *state;           /* state stack */
+    long state_len;
+    long state_capa;
     long curstate;
+    int native_vstack;     /* vbuf is used instead of vstack */
     VALUE vstack;
+    VALUE *vbuf;           /* value stack (native mode) */
+    long vbuf_len;
+    long vbuf_capa;
     VALUE tstack;
     VALUE t;
-    long shift_n;
-    long reduce_n;
     long ruleno;
 
     long errstatus;         /* nonzero in error recovering mode */
@@ -179,15 +302,180 @@ struct cparse_params {
     int sys_debug;          /* system level debug */
 
     long i;                 /* table index */
+
+    int in_use;             /* a parse is running with these params */
+
+    /* parse statistics, counted when @racc_collect_statistics is set */
+    int stats;
+    long *stat_buf;         /* stat_nrules + stat_nstates counters */
+    long stat_nrules;       /* reductions by each rule */
+    long stat_nstates;      /* visits of each state */
+    long stat_tokens;
+    long stat_shifts;
+    long stat_max_depth;
+
+    /* ring buffer of the last trace_capa events, kept when
+       @racc_trace_size is set; see Racc::ParseTrace */
+    int32_t *trace_buf;     /* TRACE_FIELDS int32s per event */
+    long trace_capa;
+    long trace_count;       /* events of the parse, including overwritten */
 };
 
+/* kinds of trace events, as Racc::ParseTrace::READ etc. */
+#define TRACE_READ    1
+#define TRACE_SHIFT   2
+#define TRACE_REDUCE  3
+#define TRACE_ERROR   4
+#define TRACE_POP     5
+#define TRACE_ACCEPT  6
+#define TRACE_FIELDS  4   /* kind, state, token, rule */
+
+/* Records an event in the state the parser is in after it. */
+#define TRACE(v, kind, tok, rule) do { \
+    if ((v)->trace_capa) trace_event(v, kind, tok, rule); \
+} while (0)
+
+static void
+trace_event(struct cparse_params *v, int kind, long tok, long rule)
+{
+    int32_t *e = v->trace_buf + (v->trace_count % v->trace_capa) * TRACE_FIELDS;
+
+    e[0] = kind;
+    e[1] = (int32_t)v->curstate;
+    e[2] = (int32_t)tok;
+    e[3] = (int32_t)rule;
+    v->trace_count++;
+}
+
+#define PARAMS_WRITE(v, member, val) \
+    RB_OBJ_WRITE((v)->value_v, &(v)->member, (val))
+
+/* -----------------------------------------------------------------------
+                          Native Parser Stacks
+----------------------------------------------------------------------- */
+
+/*
+   The state stack is always a C array of longs.  The value stack is a
+   C array of VALUEs marked by cparse_params_mark() when the parser
+   class sets Racc_native_stack, and a Ruby Array otherwise.  In native
+   mode the Array given to actions as _values (and to on_error) is a
+   snapshot, which is only built for rules flagged with RULE_USES_VALUES.
+*/
+
+static void
+state_push(struct cparse_params *v, long st)
+{
+    if (v->state_len == v->state_capa) {
+        v->state_capa *= 2;
+        REALLOC_N(v->state, long, v->state_capa);
+    }
+    v->state[v->state_len++] = st;
+    if (v->stats) {
+        if (st >= 0 && st < v->stat_nstates)
+            v->stat_buf[v->stat_nrules + st]++;
+        if (v->state_len > v->stat_max_depth)
+            v->stat_max_depth = v->state_len;
+    }
+}
+
+static VALUE
+state_ary(struct cparse_params *v)
+{
+    VALUE ary = rb_ary_new_capa(v->state_len);
+    long i;
+
+    for (i = 0; i < v->state_len; i++) {
+        rb_ary_push(ary, LONG2NUM(v->state[i]));
+    }
+    return ary;
+}
+
+static void
+vstack_push(struct cparse_params *v, VALUE val)
+{
+    if (! v->native_vstack) {
+        PUSH(v->vstack, val);
+        return;
+    }
+    if (v->vbuf_len == v->vbuf_capa) {
+        v->vbuf_capa *= 2;
+        REALLOC_N(v->vbuf, VALUE, v->vbuf_capa);
+    }
+    v->vbuf[v->vbuf_len++] = val;
+    RB_OBJ_WRITTEN(v->value_v, Qundef, val);
+}
+
+static void
+vstack_cut(struct cparse_params *v, long len)
+{
+    if (! v->native_vstack) {
+        CUT_TAIL(v->vstack, len);
+        return;
+    }
+    if (len > v->vbuf_len) len = v->vbuf_len;
+    v->vbuf_len -= len;
+}
+
+/* Returns the value LEN entries below the top of the value stack. */
+static VALUE
+vstack_peek(struct cparse_params *v, long len)
+{
+    if (! v->native_vstack) {
+        return rb_ary_entry(v->vstack, RARRAY_LEN(v->vstack) - len);
+    }
+    if (len <= 0 || len > v->vbuf_len) return Qnil;
+    return v->vbuf[v->vbuf_len - len];
+}
+
+static VALUE
+vstack_tail(struct cparse_params *v, long len)
+{
+    if (! v->native_vstack) {
+        return GET_TAIL(v->vstack, len);
+    }
+    if (len > v->vbuf_len) len = v->vbuf_len;
+    return rb_ary_new_from_values(len, v->vbuf + v->vbuf_len - len);
+}
+
+/* Copies the top LEN values of the value stack into BUF. */
+static void
+vstack_copy_tail(struct cparse_params *v, long len, VALUE *buf)
+{
+    if (! v->native_vstack) {
+        long n = RARRAY_LEN(v->vstack);
+        if (len > n)
+            rb_raise(RaccBug, "value stack unexpectedly empty");
+        MEMCPY(buf, RARRAY_CONST_PTR(v->vstack) + n - len, VALUE, len);
+        return;
+    }
+    if (len > v->vbuf_len)
+        rb_raise(RaccBug, "value stack unexpectedly empty");
+    MEMCPY(buf, v->vbuf + v->vbuf_len - len, VALUE, len);
+}
+
+/* Returns the value stack as an Array. */
+static VALUE
+vstack_ary(struct cparse_params *v)
+{
+    if (! v->native_vstack) return v->vstack;
+    return rb_ary_new_from_values(v->vbuf_len, v->vbuf);
+}
+
 /* -----------------------------------------------------------------------
                         Parser Main Routines
 ----------------------------------------------------------------------- */
 
 static VALUE racc_cparse(VALUE parser, VALUE arg, VALUE sysdebug);
+static VALUE racc_cparse_tokens(VALUE parser, VALUE arg,
+                                VALUE types, VALUE values, VALUE sysdebug);
 static VALUE racc_yyparse(VALUE parser, VALUE lexer, VALUE lexmid,
 			  VALUE arg, VALUE sysdebug);
+static VALUE acquire_params(VALUE parser, struct cparse_params **vp);
+static VALUE run_params(VALUE vparams);
+static VALUE release_params(VALUE vparams);
+static VALUE racc_push_start(VALUE parser, VALUE arg, VALUE sysdebug);
+static VALUE racc_push(VALUE parser, VALUE tok, VALUE val);
+static VALUE racc_push_result(VALUE parser);
 
 static void call_lexer(struct cparse_params *v);
 static VALUE lexer_i(RB_BLOCK_CALL_FUNC_ARGLIST(block_args, data));
@@ -197,8 +485,29 @@ static long assert_integer(VALUE n);
 static VALUE assert_hash(VALUE h);
 static VALUE initialize_params(VALUE vparams, VALUE parser, VALUE arg,
 			       VALUE lexer, VALUE lexmid);
+static void initialize_stats(struct cparse_params *v);
+static void export_stats(struct cparse_params *v);
+static void initialize_trace(struct cparse_params *v, VALUE size);
+static void export_trace(struct cparse_params *v);
 static void cparse_params_mark(void *ptr);
+static void cparse_params_free(void *ptr);
 static size_t cparse_params_memsize(const void *ptr);
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+static void cparse_params_compact(void *ptr);
+#endif
+
+static VALUE get_tables(VALUE parser, VALUE arg);
+static VALUE build_tables(VALUE klass, VALUE arg);
+static VALUE class_option(VALUE klass, ID id);
+static void pack_table(struct packed_table *t, VALUE ary);
+static int check_int_token(VALUE key, VALUE val, VALUE data);
+static void set_builtin(struct reduce_entry *rule);
+static void cparse_tables_mark(void *ptr);
+static void cparse_tables_free(void *ptr);
+static size_t cparse_tables_memsize(const void *ptr);
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+static void cparse_tables_compact(void *ptr);
+#endif
 
 static void parse_main(struct cparse_params *v,
 		       VALUE tok, VALUE val, int resume);
@@ -223,12 +532,31 @@ static const rb_data_type_t cparse_params_type = {
     "racc/cparse",
     {
 	cparse_params_mark,
-	RUBY_TYPED_DEFAULT_FREE,
+	cparse_params_free,
 	cparse_params_memsize,
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+	cparse_params_compact,
+#endif
+    },
+#ifdef RUBY_TYPED_FREE_IMMEDIATELY
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED,
+#endif
+};
+
+static const rb_data_type_t cparse_tables_type = {
+    "racc/cparse_tables",
+    {
+	cparse_tables_mark,
+	cparse_tables_free,
+	cparse_tables_memsize,
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+	cparse_tables_compact,
+#endif
     },
 #ifdef RUBY_TYPED_FREE_IMMEDIATELY
     0, 0,
-    RUBY_TYPED_FREE_IMMEDIATELY,
+    RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED,
 #endif
 };
 
@@ -238,16 +566,40 @@ racc_cparse(VALUE parser, VALUE arg, VALUE sysdebug)
     VALUE vparams;
     struct cparse_params *v;
 
-    vparams = TypedData_Make_Struct(CparseParams, struct cparse_params,
-				    &cparse_params_type, v);
+    vparams = acquire_params(parser, &v);
     D_puts("starting cparse");
     v->sys_debug = RTEST(sysdebug);
     vparams = initialize_params(vparams, parser, arg, Qnil, Qnil);
     v->lex_is_iterator = FALSE;
-    parse_main(v, Qnil, Qnil, 0);
+    return rb_ensure(run_params, vparams, release_params, vparams);
+}
 
-    RB_GC_GUARD(vparams);
-    return v->retval;
+static VALUE
+racc_cparse_tokens(VALUE parser, VALUE arg,
+                   VALUE types, VALUE values, VALUE sysdebug)
+{
+    VALUE vparams;
+    struct cparse_params *v;
+
+    if (RB_TYPE_P(types, T_STRING)) {
+        if (RSTRING_LEN(types) % sizeof(int32_t) != 0)
+            rb_raise(rb_eArgError, "packed token ids must be int32s");
+    }
+    else {
+        Check_Type(types, T_ARRAY);
+    }
+    Check_Type(values, T_ARRAY);
+
+    vparams = acquire_params(parser, &v);
+    D_puts("starting cparse with token buffer");
+    v->sys_debug = RTEST(sysdebug);
+    vparams = initialize_params(vparams, parser, arg, Qnil, Qnil);
+    v->lex_is_iterator = FALSE;
+    v->lex_from_buffer = TRUE;
+    PARAMS_WRITE(v, tok_types, types);
+    PARAMS_WRITE(v, tok_values, values);
+    v->tok_pos = 0;
+    return rb_ensure(run_params, vparams, release_params, vparams);
 }
 
 static VALUE
@@ -256,30 +608,147 @@ racc_yyparse(VALUE parser, VALUE lexer, VALUE lexmid, VALUE arg, VALUE sysdebug)
     VALUE vparams;
     struct cparse_params *v;
 
-    vparams = TypedData_Make_Struct(CparseParams, struct cparse_params,
-				    &cparse_params_type, v);
+    vparams = acquire_params(parser, &v);
     v->sys_debug = RTEST(sysdebug);
     D_puts("start C yyparse");
     vparams = initialize_params(vparams, parser, arg, lexer, lexmid);
     v->lex_is_iterator = TRUE;
     D_puts("params initialized");
-    parse_main(v, Qnil, Qnil, 0);
-    call_lexer(v);
-    if (!v->fin) {
-        rb_raise(rb_eArgError, "%s() is finished before EndOfToken",
-                 rb_id2name(v->lexmid));
+    return rb_ensure(run_params, vparams, release_params, vparams);
+}
+
+/* Each parser keeps the params object of its last parse in a hidden
+   instance variable, so that the next parse can reuse it and its stacks
+   instead of allocating new ones.  A nested parse on the same parser
+   gets a fresh object. */
+static VALUE
+acquire_params(VALUE parser, struct cparse_params **vp)
+{
+    VALUE vparams = rb_attr_get(parser, id_params);
+    struct cparse_params *v;
+
+    if (! NIL_P(vparams)) {
+        v = rb_check_typeddata(vparams, &cparse_params_type);
+        if (! v->in_use) {
+            v->in_use = TRUE;
+            *vp = v;
+            return vparams;
+        }
+        vparams = TypedData_Make_Struct(CparseParams, struct cparse_params,
+                                        &cparse_params_type, v);
+    }
+    else {
+        vparams = TypedData_Make_Struct(CparseParams, struct cparse_params,
+                                        &cparse_params_type, v);
+        rb_ivar_set(parser, id_params, vparams);
     }
+    v->in_use = TRUE;
+    *vp = v;
+    return vparams;
+}
 
-    RB_GC_GUARD(vparams);
+static VALUE
+run_params(VALUE vparams)
+{
+    struct cparse_params *v = rb_check_typeddata(vparams, &cparse_params_type);
+
+    parse_main(v, Qnil, Qnil, 0);
+    if (v->lex_is_iterator) {
+        call_lexer(v);
+        if (!v->fin) {
+            rb_raise(rb_eArgError, "%s() is finished before EndOfToken",
+                     rb_id2name(v->lexmid));
+        }
+    }
     return v->retval;
 }
 
+/* Drops the references of the finished parse, and stacks which grew
+   unusually large, so that an idle parser does not hold on to them. */
+static VALUE
+release_params(VALUE vparams)
+{
+    struct cparse_params *v = rb_check_typeddata(vparams, &cparse_params_type);
+
+    if (v->stats) export_stats(v);
+    if (v->trace_capa) export_trace(v);
+    v->in_use = FALSE;
+    PARAMS_WRITE(v, lexer, Qnil);
+    PARAMS_WRITE(v, tok_types, Qnil);
+    PARAMS_WRITE(v, tok_values, Qnil);
+    PARAMS_WRITE(v, vstack, Qnil);
+    PARAMS_WRITE(v, tstack, Qnil);
+    PARAMS_WRITE(v, retval, Qnil);
+    v->vbuf_len = 0;
+    if (v->state_capa > STACK_KEEP_LEN) {
+        REALLOC_N(v->state, long, STACK_INIT_LEN);
+        v->state_capa = STACK_INIT_LEN;
+    }
+    if (v->vbuf_capa > STACK_KEEP_LEN) {
+        REALLOC_N(v->vbuf, VALUE, STACK_INIT_LEN);
+        v->vbuf_capa = STACK_INIT_LEN;
+    }
+    return Qnil;
+}
+
 static void
 call_lexer(struct cparse_params *v)
 {
     rb_block_call(v->lexer, v->lexmid, 0, NULL, lexer_i, v->value_v);
 }
 
+/* The push parser runs parse_main as yyparse does, but is resumed by
+   Racc::PushParser#push instead of the lexer's block.  The params object
+   is kept in a hidden instance variable of the parser between calls. */
+
+static VALUE
+racc_push_start(VALUE parser, VALUE arg, VALUE sysdebug)
+{
+    VALUE vparams;
+    struct cparse_params *v;
+
+    vparams = TypedData_Make_Struct(CparseParams, struct cparse_params,
+				    &cparse_params_type, v);
+    v->sys_debug = RTEST(sysdebug);
+    D_puts("start C push parser");
+    vparams = initialize_params(vparams, parser, arg, Qnil, Qnil);
+    v->lex_is_iterator = TRUE;
+    rb_ivar_set(parser, id_push_params, vparams);
+    parse_main(v, Qnil, Qnil, 0);
+    if (v->fin && v->stats) export_stats(v);
+    if (v->fin && v->trace_capa) export_trace(v);
+    return v->fin ? Qtrue : Qfalse;
+}
+
+static struct cparse_params *
+push_params(VALUE parser)
+{
+    VALUE vparams = rb_attr_get(parser, id_push_params);
+
+    if (NIL_P(vparams))
+        rb_raise(rb_eArgError, "push parser is not started");
+    return rb_check_typeddata(vparams, &cparse_params_type);
+}
+
+static VALUE
+racc_push(VALUE parser, VALUE tok, VALUE val)
+{
+    struct cparse_params *v = push_params(parser);
+
+    if (v->fin)
+        rb_raise(rb_eArgError, "token given after the end of parse");
+    parse_main(v, tok, val, 1);
+    if (v->fin && v->stats) export_stats(v);
+    if (v->fin && v->trace_capa) export_trace(v);
+    return v->fin ? Qtrue : Qfalse;
+}
+
+static VALUE
+racc_push_result(VALUE parser)
+{
+    return push_params(parser)->retval;
+}
+
 static VALUE
 lexer_i(RB_BLOCK_CALL_FUNC_ARGLIST(block_args, data))
 {
@@ -321,29 +790,15 @@ initialize_params(VALUE vparams, VALUE parser, VALUE arg, VALUE lexer, VALUE lex
     struct cparse_params *v = rb_check_typeddata(vparams, &cparse_params_type);
 
     v->value_v = vparams;
-    v->parser = parser;
-    v->lexer = lexer;
+    PARAMS_WRITE(v, parser, parser);
+    PARAMS_WRITE(v, lexer, lexer);
     if (! NIL_P(lexmid))
         v->lexmid = value_to_id(lexmid);
 
     v->debug = RTEST(rb_ivar_get(parser, id_yydebug));
 
-    Check_Type(arg, T_ARRAY);
-    if (!(13 <= RARRAY_LEN(arg) && RARRAY_LEN(arg) <= 14))
-        rb_raise(RaccBug, "[Racc Bug] wrong arg.size %ld", RARRAY_LEN(arg));
-    v->action_table   = assert_array  (rb_ary_entry(arg,  0));
-    v->action_check   = assert_array  (rb_ary_entry(arg,  1));
-    v->action_default = assert_array  (rb_ary_entry(arg,  2));
-    v->action_pointer = assert_array  (rb_ary_entry(arg,  3));
-    v->goto_table     = assert_array  (rb_ary_entry(arg,  4));
-    v->goto_check     = assert_array  (rb_ary_entry(arg,  5));
-    v->goto_default   = assert_array  (rb_ary_entry(arg,  6));
-    v->goto_pointer   = assert_array  (rb_ary_entry(arg,  7));
-    v->nt_base        = assert_integer(rb_ary_entry(arg,  8));
-    v->reduce_table   = assert_array  (rb_ary_entry(arg,  9));
-    v->token_table    = assert_hash   (rb_ary_entry(arg, 10));
-    v->shift_n        = assert_integer(rb_ary_entry(arg, 11));
-    v->reduce_n       = assert_integer(rb_ary_entry(arg, 12));
+    PARAMS_WRITE(v, tables_v, get_tables(parser, arg));
+    v->tables = rb_check_typeddata(v->tables_v, &cparse_tables_type);
     if (RARRAY_LEN(arg) > 13) {
         v->use_result_var = RTEST(rb_ary_entry(arg, 13));
     }
@@ -351,20 +806,48 @@ initialize_params(VALUE vparams, VALUE parser, VALUE arg, VALUE lexer, VALUE lex
         v->use_result_var = TRUE;
     }
 
-    v->tstack = v->debug ? NEW_STACK() : Qnil;
-    v->vstack = NEW_STACK();
-    v->state = NEW_STACK();
+    /* The native stacks of a reused params object are kept; the value
+       stack Array is not, since it is visible as @vstack and _values. */
+    v->native_vstack = v->tables->native_stack && !v->debug;
+    PARAMS_WRITE(v, tstack, v->debug ? NEW_STACK() : Qnil);
+    if (v->native_vstack) {
+        PARAMS_WRITE(v, vstack, Qnil);
+        v->vbuf_len = 0;
+        if (! v->vbuf) {
+            v->vbuf_capa = STACK_INIT_LEN;
+            v->vbuf = ALLOC_N(VALUE, v->vbuf_capa);
+        }
+    }
+    else {
+        PARAMS_WRITE(v, vstack, NEW_STACK());
+    }
+    v->state_len = 0;
+    if (! v->state) {
+        v->state_capa = STACK_INIT_LEN;
+        v->state = ALLOC_N(long, v->state_capa);
+    }
+    v->stats = RTEST(rb_ivar_get(parser, id_collect_stats));
+    if (v->stats) {
+        initialize_stats(v);
+    }
+    else if (! NIL_P(rb_attr_get(parser, id_statistics))) {
+        rb_ivar_set(parser, id_statistics, Qnil);
+    }
+    initialize_trace(v, rb_attr_get(parser, id_trace_size));
     v->curstate = 0;
-    PUSH(v->state, INT2FIX(0));
-    v->t = INT2FIX(FINAL_TOKEN + 1);   /* must not init to FINAL_TOKEN */
+    state_push(v, 0);
+    PARAMS_WRITE(v, t, INT2FIX(FINAL_TOKEN + 1));   /* must not init to FINAL_TOKEN */
     v->nerr = 0;
     v->errstatus = 0;
     rb_ivar_set(parser, id_errstatus, LONG2NUM(v->errstatus));
 
-    v->retval = Qnil;
+    PARAMS_WRITE(v, retval, Qnil);
     v->fin = 0;
 
     v->lex_is_iterator = FALSE;
+    v->lex_from_buffer = FALSE;
+    PARAMS_WRITE(v, tok_types, Qnil);
+    PARAMS_WRITE(v, tok_values, Qnil);
 
     rb_iv_set(parser, "@vstack", v->vstack);
     if (v->debug) {
@@ -377,35 +860,428 @@ initialize_params(VALUE vparams, VALUE parser, VALUE arg, VALUE lexer, VALUE lex
     return vparams;
 }
 
+/* Zeroes the statistics counters, which a reused params object keeps
+   as long as the tables have the same size. */
+static void
+initialize_stats(struct cparse_params *v)
+{
+    long nrules = v->tables->nrules;
+    long nstates = v->tables->action_pointer.len;
+
+    if (! v->stat_buf) {
+        v->stat_buf = ALLOC_N(long, nrules + nstates);
+    }
+    else if (v->stat_nrules + v->stat_nstates != nrules + nstates) {
+        REALLOC_N(v->stat_buf, long, nrules + nstates);
+    }
+    v->stat_nrules = nrules;
+    v->stat_nstates = nstates;
+    MEMZERO(v->stat_buf, long, nrules + nstates);
+    v->stat_tokens = 0;
+    v->stat_shifts = 0;
+    v->stat_max_depth = 0;
+}
+
+static VALUE
+counts_ary(const long *counts, long len)
+{
+    VALUE ary = rb_ary_new_capa(len);
+    long i;
+
+    for (i = 0; i < len; i++) {
+        rb_ary_push(ary, LONG2NUM(counts[i]));
+    }
+    return ary;
+}
+
+/* Sets @racc_statistics of the parser to a Hash of the counters. */
+static void
+export_stats(struct cparse_params *v)
+{
+    VALUE h = rb_hash_new();
+
+    rb_hash_aset(h, ID2SYM(rb_intern("tokens")), LONG2NUM(v->stat_tokens));
+    rb_hash_aset(h, ID2SYM(rb_intern("shifts")), LONG2NUM(v->stat_shifts));
+    rb_hash_aset(h, ID2SYM(rb_intern("reductions")),
+                 counts_ary(v->stat_buf, v->stat_nrules));
+    rb_hash_aset(h, ID2SYM(rb_intern("states")),
+                 counts_ary(v->stat_buf + v->stat_nrules, v->stat_nstates));
+    rb_hash_aset(h, ID2SYM(rb_intern("errors")), LONG2NUM(v->nerr));
+    rb_hash_aset(h, ID2SYM(rb_intern("max_depth")), LONG2NUM(v->stat_max_depth));
+    rb_ivar_set(v->parser, id_statistics, h);
+}
+
+static void
+initialize_trace(struct cparse_params *v, VALUE size)
+{
+    long capa = NIL_P(size) ? 0 : NUM2LONG(size);
+
+    if (capa < 0)
+        rb_raise(rb_eArgError, "negative racc_trace_size");
+    if (capa != v->trace_capa) {
+        if (capa == 0) {
+            xfree(v->trace_buf);
+            v->trace_buf = NULL;
+        }
+        else {
+            REALLOC_N(v->trace_buf, int32_t, capa * TRACE_FIELDS);
+        }
+        v->trace_capa = capa;
+    }
+    v->trace_count = 0;
+}
+
+/* Sets @racc_trace_data of the parser to the recorded events in the
+   order they happened, and @racc_trace_count to the number of all. */
+static void
+export_trace(struct cparse_params *v)
+{
+    const long esize = TRACE_FIELDS * sizeof(int32_t);
+    long n = v->trace_count < v->trace_capa ? v->trace_count : v->trace_capa;
+    long head = v->trace_count > v->trace_capa ? v->trace_count % v->trace_capa : 0;
+    VALUE str = rb_str_buf_new(n * esize);
+
+    rb_str_cat(str, (const char *)(v->trace_buf + head * TRACE_FIELDS),
+               (n - head) * esize);
+    rb_str_cat(str, (const char *)v->trace_buf, head * esize);
+    rb_ivar_set(v->parser, id_trace_data, str);
+    rb_ivar_set(v->parser, id_trace_count, LONG2NUM(v->trace_count));
+}
+
+/* Returns the packed tables of ARG, which are cached in the parser class.
+   Other Ractors must not share the cache with the main Ractor: they keep
+   their own one in the Ractor local storage instead. */
+static VALUE
+get_tables(VALUE parser, VALUE arg)
+{
+    VALUE klass = rb_obj_class(parser);
+    VALUE cache = Qnil;
+    VALUE tables_v;
+    struct cparse_tables *tables;
+
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+    VALUE main_p;
+
+    if (! rb_ractor_local_storage_value_lookup(main_ractor_key, &main_p)) {
+        cache = rb_ractor_local_storage_value(ractor_tables_key);
+        if (NIL_P(cache)) {
+            cache = rb_hash_new();
+            rb_ractor_local_storage_value_set(ractor_tables_key, cache);
+        }
+    }
+#endif
+    tables_v = NIL_P(cache) ? rb_attr_get(klass, id_tables)
+                            : rb_hash_lookup(cache, klass);
+    if (! NIL_P(tables_v)) {
+        tables = rb_check_typeddata(tables_v, &cparse_tables_type);
+        if (tables->arg == arg) return tables_v;
+    }
+    tables_v = build_tables(klass, arg);
+    if (NIL_P(cache))
+        rb_ivar_set(klass, id_tables, tables_v);
+    else
+        rb_hash_aset(cache, klass, tables_v);
+    return tables_v;
+}
+
+/* Returns the constant ID of KLASS, or nil for parsers generated
+   by older versions of Racc. */
+static VALUE
+class_option(VALUE klass, ID id)
+{
+    if (! rb_const_defined(klass, id)) return Qnil;
+    return rb_const_get(klass, id);
+}
+
+static VALUE
+build_tables(VALUE klass, VALUE arg)
+{
+    VALUE tables_v, reduce_table, rule_flags;
+    struct cparse_tables *t;
+    long i;
+
+    Check_Type(arg, T_ARRAY);
+    if (!(13 <= RARRAY_LEN(arg) && RARRAY_LEN(arg) <= 14))
+        rb_raise(RaccBug, "[Racc Bug] wrong arg.size %ld", RARRAY_LEN(arg));
+
+    tables_v = TypedData_Make_Struct(0, struct cparse_tables,
+                                     &cparse_tables_type, t);
+    RB_OBJ_WRITE(tables_v, &t->arg, arg);
+    t->token_table = Qnil;
+    pack_table(&t->action_table,   rb_ary_entry(arg,  0));
+    pack_table(&t->action_check,   rb_ary_entry(arg,  1));
+    pack_table(&t->action_default, rb_ary_entry(arg,  2));
+    pack_table(&t->action_pointer, rb_ary_entry(arg,  3));
+    pack_table(&t->goto_table,     rb_ary_entry(arg,  4));
+    pack_table(&t->goto_check,     rb_ary_entry(arg,  5));
+    pack_table(&t->goto_default,   rb_ary_entry(arg,  6));
+    pack_table(&t->goto_pointer,   rb_ary_entry(arg,  7));
+    t->nt_base        = assert_integer(rb_ary_entry(arg,  8));
+    reduce_table      = assert_array  (rb_ary_entry(arg,  9));
+    RB_OBJ_WRITE(tables_v, &t->token_table,
+                 assert_hash(rb_ary_entry(arg, 10)));
+    t->shift_n        = assert_integer(rb_ary_entry(arg, 11));
+    t->reduce_n       = assert_integer(rb_ary_entry(arg, 12));
+
+    t->nrules = RARRAY_LEN(reduce_table) / 3;
+    t->rules = ALLOC_N(struct reduce_entry, t->nrules);
+    for (i = 0; i < t->nrules; i++) {
+        t->rules[i].len       = assert_integer(rb_ary_entry(reduce_table, i*3));
+        t->rules[i].reduce_to = assert_integer(rb_ary_entry(reduce_table, i*3+1));
+        t->rules[i].mid       = value_to_id(rb_ary_entry(reduce_table, i*3+2));
+        t->rules[i].flags     = 0;
+        set_builtin(&t->rules[i]);
+    }
+
+    rule_flags = class_option(klass, id_rule_flags);
+    if (! NIL_P(rule_flags)) {
+        assert_array(rule_flags);
+        for (i = 0; i < t->nrules && i < RARRAY_LEN(rule_flags); i++) {
+            t->rules[i].flags = NUM2INT(rb_ary_entry(rule_flags, i));
+        }
+    }
+    t->native_stack = RTEST(class_option(klass, id_native_stack));
+    t->positional_args = RTEST(class_option(klass, id_positional_args));
+    t->check_base = RTEST(class_option(klass, id_shared_action_rows));
+    t->int_tokens = TRUE;
+    rb_hash_foreach(t->token_table, check_int_token, (VALUE)t);
+
+    return tables_v;
+}
+
+static void
+set_builtin(struct reduce_entry *rule)
+{
+    static const char prefix[] = "_racc_builtin_";
+    const char *name;
+    char *end;
+
+    rule->builtin = 0;
+    rule->nth = 0;
+    if (rule->mid == id_noreduce) {
+        rule->builtin = BUILTIN_VAL;
+        return;
+    }
+    name = rb_id2name(rule->mid);
+    if (!name || strncmp(name, prefix, sizeof(prefix) - 1) != 0)
+        return;
+    name += sizeof(prefix) - 1;
+    if (strcmp(name, "nil") == 0)
+        rule->builtin = BUILTIN_NIL;
+    else if (strcmp(name, "array") == 0)
+        rule->builtin = BUILTIN_ARRAY;
+    else if (strcmp(name, "append") == 0)
+        rule->builtin = BUILTIN_APPEND;
+    else if (strcmp(name, "prepend") == 0)
+        rule->builtin = BUILTIN_PREPEND;
+    else if (strncmp(name, "val", 3) == 0 && ISDIGIT(name[3])) {
+        rule->nth = strtol(name + 3, &end, 10);
+        if (*end == '\0')
+            rule->builtin = BUILTIN_VAL;
+    }
+}
+
+/* The lexer may return terminal ids directly, unless some token is an
+   Integer itself. */
+static int
+check_int_token(VALUE key, VALUE val, VALUE data)
+{
+    struct cparse_tables *t = (struct cparse_tables *)data;
+
+    if (RB_INTEGER_TYPE_P(key)) {
+        t->int_tokens = FALSE;
+        return ST_STOP;
+    }
+    return ST_CONTINUE;
+}
+
+/* The I-th entry of a packed_tables String, or TABLE_NIL. */
+static long
+packed_entry(VALUE str, long i)
+{
+    const unsigned char *s = (const unsigned char *)RSTRING_PTR(str) + i * 4;
+    int32_t n = (int32_t)((uint32_t)s[0] | (uint32_t)s[1] << 8 |
+                          (uint32_t)s[2] << 16 | (uint32_t)s[3] << 24);
+
+    return (n == INT32_MIN) ? TABLE_NIL : n;
+}
+
+static long
+table_source_entry(VALUE src, long i)
+{
+    VALUE e;
+
+    if (RB_TYPE_P(src, T_STRING))
+        return packed_entry(src, i);
+    e = rb_ary_entry(src, i);
+    return NIL_P(e) ? TABLE_NIL : NUM2LONG(e);
+}
+
+static void
+pack_table(struct packed_table *t, VALUE src)
+{
+    long i, n;
+
+    if (RB_TYPE_P(src, T_STRING)) {
+        if (RSTRING_LEN(src) % 4 != 0)
+            rb_raise(RaccBug, "[Racc Bug] broken packed table");
+        t->len = RSTRING_LEN(src) / 4;
+    }
+    else {
+        assert_array(src);
+        t->len = RARRAY_LEN(src);
+    }
+    t->wide = FALSE;
+    for (i = 0; i < t->len; i++) {
+        n = table_source_entry(src, i);
+        if (n == TABLE_NIL) continue;
+        if (n <= INT32_MIN || n > INT32_MAX)
+            rb_raise(RaccBug, "[Racc Bug] table entry out of range: %ld", n);
+        if (n <= INT16_MIN || n > INT16_MAX)
+            t->wide = TRUE;
+    }
+
+    if (t->wide) {
+        int32_t *p = ALLOC_N(int32_t, t->len);
+        t->ptr = p;
+        for (i = 0; i < t->len; i++) {
+            n = table_source_entry(src, i);
+            p[i] = (n == TABLE_NIL) ? INT32_MIN : (int32_t)n;
+        }
+    }
+    else {
+        int16_t *p = ALLOC_N(int16_t, t->len);
+        t->ptr = p;
+        for (i = 0; i < t->len; i++) {
+            n = table_source_entry(src, i);
+            p[i] = (n == TABLE_NIL) ? INT16_MIN : (int16_t)n;
+        }
+    }
+}
+
+#define PACKED_TABLE_SIZE(t) ((t).len * ((t).wide ? sizeof(int32_t) : sizeof(int16_t)))
+
+static void
+cparse_tables_mark(void *ptr)
+{
+    struct cparse_tables *t = (struct cparse_tables*)ptr;
+
+    GC_MARK_MOVABLE(t->arg);
+    GC_MARK_MOVABLE(t->token_table);
+}
+
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+static void
+cparse_tables_compact(void *ptr)
+{
+    struct cparse_tables *t = (struct cparse_tables*)ptr;
+
+    t->arg = GC_LOCATION(t->arg);
+    t->token_table = GC_LOCATION(t->token_table);
+}
+#endif
+
+static void
+cparse_tables_free(void *ptr)
+{
+    struct cparse_tables *t = (struct cparse_tables*)ptr;
+
+    xfree(t->action_table.ptr);
+    xfree(t->action_check.ptr);
+    xfree(t->action_default.ptr);
+    xfree(t->action_pointer.ptr);
+    xfree(t->goto_table.ptr);
+    xfree(t->goto_check.ptr);
+    xfree(t->goto_default.ptr);
+    xfree(t->goto_pointer.ptr);
+    xfree(t->rules);
+    xfree(t);
+}
+
+static size_t
+cparse_tables_memsize(const void *ptr)
+{
+    const struct cparse_tables *t = (const struct cparse_tables*)ptr;
+
+    return sizeof(struct cparse_tables)
+        + PACKED_TABLE_SIZE(t->action_table)
+        + PACKED_TABLE_SIZE(t->action_check)
+        + PACKED_TABLE_SIZE(t->action_default)
+        + PACKED_TABLE_SIZE(t->action_pointer)
+        + PACKED_TABLE_SIZE(t->goto_table)
+        + PACKED_TABLE_SIZE(t->goto_check)
+        + PACKED_TABLE_SIZE(t->goto_default)
+        + PACKED_TABLE_SIZE(t->goto_pointer)
+        + t->nrules * sizeof(struct reduce_entry);
+}
+
 static void
 cparse_params_mark(void *ptr)
+{
+    struct cparse_params *v = (struct cparse_params*)ptr;
+    long i;
+
+    GC_MARK_MOVABLE(v->value_v);
+    GC_MARK_MOVABLE(v->parser);
+    GC_MARK_MOVABLE(v->lexer);
+    GC_MARK_MOVABLE(v->tok_types);
+    GC_MARK_MOVABLE(v->tok_values);
+    GC_MARK_MOVABLE(v->tables_v);
+    GC_MARK_MOVABLE(v->vstack);
+    for (i = 0; i < v->vbuf_len; i++) {
+        GC_MARK_MOVABLE(v->vbuf[i]);
+    }
+    GC_MARK_MOVABLE(v->tstack);
+    GC_MARK_MOVABLE(v->t);
+    GC_MARK_MOVABLE(v->retval);
+}
+
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+static void
+cparse_params_compact(void *ptr)
+{
+    struct cparse_params *v = (struct cparse_params*)ptr;
+    long i;
+
+    v->value_v = GC_LOCATION(v->value_v);
+    v->parser = GC_LOCATION(v->parser);
+    v->lexer = GC_LOCATION(v->lexer);
+    v->tok_types = GC_LOCATION(v->tok_types);
+    v->tok_values = GC_LOCATION(v->tok_values);
+    v->tables_v = GC_LOCATION(v->tables_v);
+    v->vstack = GC_LOCATION(v->vstack);
+    for (i = 0; i < v->vbuf_len; i++) {
+        v->vbuf[i] = GC_LOCATION(v->vbuf[i]);
+    }
+    v->tstack = GC_LOCATION(v->tstack);
+    v->t = GC_LOCATION(v->t);
+    v->retval = GC_LOCATION(v->retval);
+}
+#endif
+
+static void
+cparse_params_free(void *ptr)
 {
     struct cparse_params *v = (struct cparse_params*)ptr;
 
-    rb_gc_mark(v->value_v);
-    rb_gc_mark(v->parser);
-    rb_gc_mark(v->lexer);
-    rb_gc_mark(v->action_table);
-    rb_gc_mark(v->action_check);
-    rb_gc_mark(v->action_default);
-    rb_gc_mark(v->action_pointer);
-    rb_gc_mark(v->goto_table);
-    rb_gc_mark(v->goto_check);
-    rb_gc_mark(v->goto_default);
-    rb_gc_mark(v->goto_pointer);
-    rb_gc_mark(v->reduce_table);
-    rb_gc_mark(v->token_table);
-    rb_gc_mark(v->state);
-    rb_gc_mark(v->vstack);
-    rb_gc_mark(v->tstack);
-    rb_gc_mark(v->t);
-    rb_gc_mark(v->retval);
+    xfree(v->state);
+    xfree(v->vbuf);
+    xfree(v->stat_buf);
+    xfree(v->trace_buf);
+    xfree(v);
 }
 
 static size_t
 cparse_params_memsize(const void *ptr)
 {
-    return sizeof(struct cparse_params);
+    const struct cparse_params *v = (const struct cparse_params*)ptr;
+    size_t size = sizeof(struct cparse_params);
+
+    if (v->state) size += v->state_capa * sizeof(long);
+    if (v->vbuf) size += v->vbuf_capa * sizeof(VALUE);
+    if (v->stat_buf) size += (v->stat_nrules + v->stat_nstates) * sizeof(long);
+    size += v->trace_capa * TRACE_FIELDS * sizeof(int32_t);
+    return size;
 }
 
 static void
@@ -437,12 +1313,43 @@ extract_user_token(struct cparse_params *v, VALUE block_args,
     *val = AREF(block_args, 1);
 }
 
+/* Reads the next token given to Parser#do_parse_tokens. */
+static void
+buffered_token(struct cparse_params *v, VALUE *tok, VALUE *val)
+{
+    long pos = v->tok_pos;
+    int32_t id;
+
+    if (RB_TYPE_P(v->tok_types, T_STRING)) {
+        if (pos >= RSTRING_LEN(v->tok_types) / (long)sizeof(int32_t))
+            goto eof;
+        memcpy(&id, RSTRING_PTR(v->tok_types) + pos * sizeof(int32_t),
+               sizeof(int32_t));
+        *tok = INT2FIX(id);
+    }
+    else {
+        if (pos >= RARRAY_LEN(v->tok_types))
+            goto eof;
+        *tok = RARRAY_AREF(v->tok_types, pos);
+    }
+    *val = rb_ary_entry(v->tok_values, pos);
+    v->tok_pos++;
+    return;
+
+  eof:
+    *tok = Qfalse;
+    *val = rb_str_new("$", 1);
+}
+
 #define SHIFT(v,act,tok,val) shift(v,act,tok,val)
 #define REDUCE(v,act) do {\
     switch (reduce(v,act)) {  \
       case 0: /* normal */    \
         break;                \
       case 1: /* yyerror */   \
+        /* the RHS states are already popped */ \
+        v->curstate = v->state[v->state_len - 1]; \
+        TRACE(v, TRACE_ERROR, FIX2LONG(v->t), -1); \
         goto user_yyerror;    \
       case 2: /* yyaccept */  \
         D_puts("u accept");   \
@@ -457,9 +1364,8 @@ parse_main(struct cparse_params *v, VALUE tok, VALUE val, int resume)
 {
     long i;              /* table index */
     long act;            /* action type */
-    VALUE act_value;     /* action type, VALUE version */
     int read_next = 1;   /* true if we need to read next token */
-    VALUE tmp;
+    long tmp;
 
     if (resume)
         goto resume;
@@ -470,10 +1376,9 @@ parse_main(struct cparse_params *v, VALUE tok, VALUE val, int resume)
         D_puts("");
 
         D_printf("(act) k1=%ld\n", v->curstate);
-        tmp = AREF(v->action_pointer, v->curstate);
-        if (NIL_P(tmp)) goto notfound;
+        i = TREF(v, action_pointer, v->curstate);
+        if (i == TABLE_NIL) goto notfound;
         D_puts("(act) pointer[k1] ok");
-        i = NUM2LONG(tmp);
 
         D_printf("read_next=%d\n", read_next);
         if (read_next && (v->t != vFINAL_TOKEN)) {
@@ -486,16 +1391,27 @@ parse_main(struct cparse_params *v, VALUE tok, VALUE val, int resume)
                 D_puts("resumed");
                 i = v->i;  /* load i */
             }
+            else if (v->lex_from_buffer) {
+                buffered_token(v, &tok, &val);
+            }
             else {
                 D_puts("next_token");
-                tmp = rb_funcall(v->parser, id_nexttoken, 0);
-                extract_user_token(v, tmp, &tok, &val);
+                extract_user_token(v, rb_funcall(v->parser, id_nexttoken, 0),
+                                   &tok, &val);
             }
             /* convert token */
-            v->t = rb_hash_aref(v->token_table, tok);
-            if (NIL_P(v->t)) {
-                v->t = vERROR_TOKEN;
+            if (FIXNUM_P(tok) && v->tables->int_tokens &&
+                FIX2LONG(tok) >= 0 && FIX2LONG(tok) < v->tables->nt_base) {
+                PARAMS_WRITE(v, t, tok);
             }
+            else {
+                PARAMS_WRITE(v, t, rb_hash_aref(v->tables->token_table, tok));
+                if (NIL_P(v->t)) {
+                    PARAMS_WRITE(v, t, vERROR_TOKEN);
+                }
+            }
+            if (v->stats && v->t != vFINAL_TOKEN) v->stat_tokens++;
+            TRACE(v, TRACE_READ, FIX2LONG(v->t), -1);
             D_printf("(act) t(k2)=%ld\n", NUM2LONG(v->t));
             if (v->debug) {
                 rb_funcall(v->parser, id_d_read_token,
@@ -504,19 +1420,17 @@ parse_main(struct cparse_params *v, VALUE tok, VALUE val, int resume)
         }
         read_next = 0;
 
-        i += NUM2LONG(v->t);
+        i += FIX2LONG(v->t);
         D_printf("(act) i=%ld\n", i);
         if (i < 0) goto notfound;
 
-        act_value = AREF(v->action_table, i);
-        if (NIL_P(act_value)) goto notfound;
-        act = NUM2LONG(act_value);
+        act = TREF(v, action_table, i);
+        if (act == TABLE_NIL) goto notfound;
         D_printf("(act) table[i]=%ld\n", act);
 
-        tmp = AREF(v->action_check, i);
-        if (NIL_P(tmp)) goto notfound;
-        if (NUM2LONG(tmp) != v->curstate) goto notfound;
-        D_printf("(act) check[i]=%ld\n", NUM2LONG(tmp));
+        tmp = TREF(v, action_check, i);
+        if (tmp != ACTION_CHECK_KEY(v, i - FIX2LONG(v->t))) goto notfound;
+        D_printf("(act) check[i]=%ld\n", tmp);
 
         D_puts("(act) found");
       act_fixed:
@@ -525,13 +1439,12 @@ parse_main(struct cparse_params *v, VALUE tok, VALUE val, int resume)
 
       notfound:
         D_puts("(act) not found: use default");
-        act_value = AREF(v->action_default, v->curstate);
-        act = NUM2LONG(act_value);
+        act = TREF(v, action_default, v->curstate);
         goto act_fixed;
 
 
       handle_act:
-        if (act > 0 && act < v->shift_n) {
+        if (act > 0 && act < v->tables->shift_n) {
             D_puts("shift");
             if (v->errstatus > 0) {
                 v->errstatus--;
@@ -540,16 +1453,16 @@ parse_main(struct cparse_params *v, VALUE tok, VALUE val, int resume)
             SHIFT(v, act, v->t, val);
             read_next = 1;
         }
-        else if (act < 0 && act > -(v->reduce_n)) {
+        else if (act < 0 && act > -(v->tables->reduce_n)) {
             D_puts("reduce");
             REDUCE(v, act);
         }
-        else if (act == -(v->reduce_n)) {
+        else if (act == -(v->tables->reduce_n)) {
             goto error;
           error_recovered:
             ;   /* goto label requires stmt */
         }
-        else if (act == v->shift_n) {
+        else if (act == v->tables->shift_n) {
             D_puts("accept");
             goto accept;
         }
@@ -559,30 +1472,34 @@ parse_main(struct cparse_params *v, VALUE tok, VALUE val, int resume)
 
         if (v->debug) {
             rb_funcall(v->parser, id_d_next_state,
-                       2, LONG2NUM(v->curstate), v->state);
+                       2, LONG2NUM(v->curstate), state_ary(v));
         }
     }
     /* not reach */
 
 
   accept:
+    TRACE(v, TRACE_ACCEPT, -1, -1);
     if (v->debug) rb_funcall(v->parser, id_d_accept, 0);
-    v->retval = rb_ary_entry(v->vstack, 0);
+    PARAMS_WRITE(v, retval, v->native_vstack ?
+                 (v->vbuf_len > 0 ? v->vbuf[0] : Qnil) :
+                 rb_ary_entry(v->vstack, 0));
     v->fin = CP_FIN_ACCEPT;
     return;
 
 
   error:
     D_printf("error detected, status=%ld\n", v->errstatus);
+    TRACE(v, TRACE_ERROR, FIX2LONG(v->t), -1);
     if (v->errstatus == 0) {
         v->nerr++;
         rb_funcall(v->parser, id_onerror,
-                   3, v->t, val, v->vstack);
+                   3, v->t, val, vstack_ary(v));
     }
   user_yyerror:
     if (v->errstatus == 3) {
         if (v->t == vFINAL_TOKEN) {
-            v->retval = Qnil;
+            PARAMS_WRITE(v, retval, Qnil);
             v->fin = CP_FIN_EOT;
             return;
         }
@@ -595,28 +1512,27 @@ parse_main(struct cparse_params *v, VALUE tok, VALUE val, int resume)
     D_printf("(err) k1=%ld\n", v->curstate);
     D_printf("(err) k2=%d (error)\n", ERROR_TOKEN);
     while (1) {
-        tmp = AREF(v->action_pointer, v->curstate);
-        if (NIL_P(tmp)) goto error_pop;
+        tmp = TREF(v, action_pointer, v->curstate);
+        if (tmp == TABLE_NIL) goto error_pop;
         D_puts("(err) pointer[k1] ok");
 
-        i = NUM2LONG(tmp) + ERROR_TOKEN;
+        i = tmp + ERROR_TOKEN;
         D_printf("(err) i=%ld\n", i);
         if (i < 0) goto error_pop;
 
-        act_value = AREF(v->action_table, i);
-        if (NIL_P(act_value)) {
+        act = TREF(v, action_table, i);
+        if (act == TABLE_NIL) {
             D_puts("(err) table[i] == nil");
             goto error_pop;
         }
-        act = NUM2LONG(act_value);
         D_printf("(err) table[i]=%ld\n", act);
 
-        tmp = AREF(v->action_check, i);
-        if (NIL_P(tmp)) {
+        tmp = TREF(v, action_check, i);
+        if (tmp == TABLE_NIL) {
             D_puts("(err) check[i] == nil");
             goto error_pop;
         }
-        if (NUM2LONG(tmp) != v->curstate) {
+        if (tmp != ACTION_CHECK_KEY(v, i - ERROR_TOKEN)) {
             D_puts("(err) check[i] != k1");
             goto error_pop;
         }
@@ -627,31 +1543,32 @@ parse_main(struct cparse_params *v, VALUE tok, VALUE val, int resume)
       error_pop:
         D_puts("(err) act not found: can't handle error token; pop");
 
-        if (RARRAY_LEN(v->state) <= 1) {
-            v->retval = Qnil;
+        if (v->state_len <= 1) {
+            PARAMS_WRITE(v, retval, Qnil);
             v->fin = CP_FIN_CANTPOP;
             return;
         }
-        POP(v->state);
-        POP(v->vstack);
-        v->curstate = num_to_long(LAST_I(v->state));
+        v->state_len--;
+        vstack_cut(v, 1);
+        v->curstate = v->state[v->state_len - 1];
+        TRACE(v, TRACE_POP, -1, -1);
         if (v->debug) {
             POP(v->tstack);
             rb_funcall(v->parser, id_d_e_pop,
-                       3, v->state, v->tstack, v->vstack);
+                       3, state_ary(v), v->tstack, v->vstack);
         }
     }
 
     /* shift/reduce error token */
-    if (act > 0 && act < v->shift_n) {
+    if (act > 0 && act < v->tables->shift_n) {
         D_puts("e shift");
-        SHIFT(v, act, ERROR_TOKEN, val);
+        SHIFT(v, act, vERROR_TOKEN, val);
     }
-    else if (act < 0 && act > -(v->reduce_n)) {
+    else if (act < 0 && act > -(v->tables->reduce_n)) {
         D_puts("e reduce");
         REDUCE(v, act);
     }
-    else if (act == v->shift_n) {
+    else if (act == v->tables->shift_n) {
         D_puts("e accept");
         goto accept;
     }
@@ -664,79 +1581,145 @@ parse_main(struct cparse_params *v, VALUE tok, VALUE val, int resume)
 static void
 shift(struct cparse_params *v, long act, VALUE tok, VALUE val)
 {
-    PUSH(v->vstack, val);
+    if (v->stats) v->stat_shifts++;
+    vstack_push(v, val);
     if (v->debug) {
         PUSH(v->tstack, tok);
         rb_funcall(v->parser, id_d_shift,
                    3, tok, v->tstack, v->vstack);
     }
     v->curstate = act;
-    PUSH(v->state, LONG2NUM(v->curstate));
+    state_push(v, v->curstate);
+    TRACE(v, TRACE_SHIFT, FIX2LONG(tok), -1);
 }
 
 static int
 reduce(struct cparse_params *v, long act)
 {
+    const struct reduce_entry *rule;
     VALUE code;
-    v->ruleno = -act * 3;
+
+    v->ruleno = -act;
+    if (v->ruleno < 0 || v->ruleno >= v->tables->nrules)
+        rb_raise(RaccBug, "[Racc Bug] wrong rule number %ld", v->ruleno);
+    rule = &v->tables->rules[v->ruleno];
+    if (v->stats) v->stat_buf[v->ruleno]++;
+    if (rule->builtin || (rule->flags & RULE_NO_JUMP)) {
+        /* The action cannot throw :racc_jump nor touch the error status. */
+        reduce0(Qnil, v->value_v, 0, NULL, Qnil);
+        return 0;
+    }
     code = rb_catch("racc_jump", reduce0, v->value_v);
     v->errstatus = num_to_long(rb_ivar_get(v->parser, id_errstatus));
     return NUM2INT(code);
 }
 
+/* Runs the built-in action of RULE on the values on top of the stack. */
+static VALUE
+builtin_action(struct cparse_params *v, const struct reduce_entry *rule)
+{
+    long len = rule->len;
+    VALUE list;
+
+    switch (rule->builtin) {
+      case BUILTIN_VAL:
+        return (rule->nth < len) ? vstack_peek(v, len - rule->nth) : Qnil;
+      case BUILTIN_NIL:
+        return Qnil;
+      case BUILTIN_ARRAY:
+        return vstack_tail(v, len);
+      case BUILTIN_APPEND:
+        list = vstack_peek(v, len);
+        if (RB_TYPE_P(list, T_ARRAY))
+            return rb_ary_push(list, vstack_peek(v, 1));
+        return rb_funcall(list, id_push, 1, vstack_peek(v, 1));
+      case BUILTIN_PREPEND:
+        if (len < 2 || !RTEST(list = vstack_peek(v, len - 1)))
+            return vstack_tail(v, len);
+        if (RB_TYPE_P(list, T_ARRAY))
+            return rb_ary_unshift(list, vstack_peek(v, len));
+        return rb_funcall(list, id_unshift, 1, vstack_peek(v, len));
+    }
+    rb_raise(RaccBug, "[Racc Bug] unknown builtin action %d", rule->builtin);
+    UNREACHABLE_RETURN(Qnil);
+}
+
 static VALUE
 reduce0(RB_BLOCK_CALL_FUNC_ARGLIST(_, data))
 {
     struct cparse_params *v = rb_check_typeddata(data, &cparse_params_type);
-    VALUE reduce_to, reduce_len, method_id;
+    const struct reduce_entry *rule;
+    VALUE reduce_to;
     long len;
     ID mid;
-    VALUE tmp, tmp_t = Qundef, tmp_v = Qundef;
+    VALUE tmp = Qnil, tmp_t = Qundef, tmp_v = Qundef, values;
+    VALUE *args = NULL, args_buf = 0;
     long i, k1, k2;
-    VALUE goto_state;
+    long goto_state;
 
-    reduce_len = rb_ary_entry(v->reduce_table, v->ruleno);
-    reduce_to  = rb_ary_entry(v->reduce_table, v->ruleno+1);
-    method_id  = rb_ary_entry(v->reduce_table, v->ruleno+2);
-    len = NUM2LONG(reduce_len);
-    mid = value_to_id(method_id);
+    rule = &v->tables->rules[v->ruleno];
+    len = rule->len;
+    reduce_to = LONG2NUM(rule->reduce_to);
+    mid = rule->mid;
+
+    /* In positional_args mode the action takes the RHS values, _values
+       and result as separate arguments, so no Array is built for them. */
+    if (!rule->builtin && v->tables->positional_args)
+        args = ALLOCV_N(VALUE, args_buf, len + 2);
 
     /* call action */
+    if (rule->builtin)
+        tmp = builtin_action(v, rule);
     if (len == 0) {
-        tmp = Qnil;
-        if (mid != id_noreduce)
+        if (!rule->builtin && !args)
             tmp_v = rb_ary_new();
         if (v->debug)
             tmp_t = rb_ary_new();
     }
     else {
-        if (mid != id_noreduce) {
-            tmp_v = GET_TAIL(v->vstack, len);
-            tmp = rb_ary_entry(tmp_v, 0);
+        if (args) {
+            vstack_copy_tail(v, len, args);
+            tmp = args[0];
         }
-        else {
-            tmp = rb_ary_entry(v->vstack, RARRAY_LEN(v->vstack) - len);
+        else if (!rule->builtin) {
+            tmp_v = vstack_tail(v, len);
+            tmp = rb_ary_entry(tmp_v, 0);
         }
-        CUT_TAIL(v->vstack, len);
+        vstack_cut(v, len);
         if (v->debug) {
             tmp_t = GET_TAIL(v->tstack, len);
             CUT_TAIL(v->tstack, len);
         }
-        CUT_TAIL(v->state, len);
+        if (len >= v->state_len)
+            rb_raise(RaccBug, "state stack unexpectedly empty");
+        v->state_len -= len;
     }
-    if (mid != id_noreduce) {
-        if (v->use_result_var) {
+    if (!rule->builtin) {
+        if (! v->native_vstack)
+            values = v->vstack;
+        else if (rule->flags & RULE_USES_VALUES)
+            values = vstack_ary(v);
+        else
+            values = Qnil;
+        if (args) {
+            args[len] = values;
+            args[len + 1] = tmp;
+            tmp = rb_funcallv(v->parser, mid,
+                              len + (v->use_result_var ? 2 : 1), args);
+            ALLOCV_END(args_buf);
+        }
+        else if (v->use_result_var) {
             tmp = rb_funcall(v->parser, mid,
-                             3, tmp_v, v->vstack, tmp);
+                             3, tmp_v, values, tmp);
         }
         else {
             tmp = rb_funcall(v->parser, mid,
-                             2, tmp_v, v->vstack);
+                             2, tmp_v, values);
         }
     }
 
     /* then push result */
-    PUSH(v->vstack, tmp);
+    vstack_push(v, tmp);
     if (v->debug) {
         PUSH(v->tstack, reduce_to);
         rb_funcall(v->parser, id_d_reduce,
@@ -744,51 +1727,316 @@ reduce0(RB_BLOCK_CALL_FUNC_ARGLIST(_, data))
     }
 
     /* calculate transition state */
-    if (RARRAY_LEN(v->state) == 0)
-        rb_raise(RaccBug, "state stack unexpectedly empty");
-    k2 = num_to_long(LAST_I(v->state));
-    k1 = num_to_long(reduce_to) - v->nt_base;
+    k2 = v->state[v->state_len - 1];
+    k1 = rule->reduce_to - v->tables->nt_base;
     D_printf("(goto) k1=%ld\n", k1);
     D_printf("(goto) k2=%ld\n", k2);
 
-    tmp = AREF(v->goto_pointer, k1);
-    if (NIL_P(tmp)) goto notfound;
+    i = TREF(v, goto_pointer, k1);
+    if (i == TABLE_NIL) goto notfound;
 
-    i = NUM2LONG(tmp) + k2;
+    i += k2;
     D_printf("(goto) i=%ld\n", i);
     if (i < 0) goto notfound;
 
-    goto_state = AREF(v->goto_table, i);
-    if (NIL_P(goto_state)) {
+    goto_state = TREF(v, goto_table, i);
+    if (goto_state == TABLE_NIL) {
         D_puts("(goto) table[i] == nil");
         goto notfound;
     }
-    D_printf("(goto) table[i]=%ld (goto_state)\n", NUM2LONG(goto_state));
+    D_printf("(goto) table[i]=%ld (goto_state)\n", goto_state);
 
-    tmp = AREF(v->goto_check, i);
-    if (NIL_P(tmp)) {
-        D_puts("(goto) check[i] == nil");
-        goto notfound;
-    }
-    if (tmp != LONG2NUM(k1)) {
+    if (TREF(v, goto_check, i) != k1) {
         D_puts("(goto) check[i] != table[i]");
         goto notfound;
     }
-    D_printf("(goto) check[i]=%ld\n", NUM2LONG(tmp));
+    D_printf("(goto) check[i]=%ld\n", k1);
 
     D_puts("(goto) found");
   transit:
-    PUSH(v->state, goto_state);
-    v->curstate = NUM2LONG(goto_state);
+    state_push(v, goto_state);
+    v->curstate = goto_state;
+    TRACE(v, TRACE_REDUCE, -1, v->ruleno);
     return INT2FIX(0);
 
   notfound:
     D_puts("(goto) not found: use default");
     /* overwrite `goto-state' by default value */
-    goto_state = AREF(v->goto_default, k1);
+    goto_state = TREF(v, goto_default, k1);
     goto transit;
 }
 
+/* -----------------------------------------------------------------------
+                  Lookahead Computation (for the generator)
+----------------------------------------------------------------------- */
+
+/* Racc::Cparse.digraph(map, relation) does the same as States#digraph:
+   MAP is an Array of Integer bitmaps and RELATION an Array of nil or
+   Arrays of indexes into MAP.  The bitmaps are unpacked into one block
+   of words, so that OR-ing them does not allocate a Bignum each time. */
+
+#define SET_WORD_BITS (sizeof(unsigned long) * CHAR_BIT)
+#define SET_PACK_FLAGS (INTEGER_PACK_LSWORD_FIRST|INTEGER_PACK_NATIVE_BYTE_ORDER)
+
+struct digraph {
+    long n;
+    long nwords;
+    unsigned long *bits;    /* n rows of nwords words */
+    long *index;
+    long *vertices;         /* vertices in the current traversal */
+    long *frames;           /* DFS stack: vertex, height, edge position */
+    VALUE relation;
+};
+
+#define SET_ROW(g, i) ((g)->bits + (i) * (g)->nwords)
+
+static void
+set_or(struct digraph *g, long to, long from)
+{
+    unsigned long *dst = SET_ROW(g, to);
+    const unsigned long *src = SET_ROW(g, from);
+    long w;
+
+    for (w = 0; w < g->nwords; w++)
+        dst[w] |= src[w];
+}
+
+static VALUE
+digraph_edges(struct digraph *g, long i)
+{
+    VALUE rp = rb_ary_entry(g->relation, i);
+
+    if (NIL_P(rp))
+        return Qnil;
+    Check_Type(rp, T_ARRAY);
+    return rp;
+}
+
+static long
+digraph_edge(struct digraph *g, VALUE rp, long pos)
+{
+    long j = NUM2LONG(rb_ary_entry(rp, pos));
+
+    if (j < 0 || j >= g->n)
+        rb_raise(rb_eIndexError, "relation index %ld out of range", j);
+    return j;
+}
+
+/* Iterative version of States#traverse */
+static void
+digraph_traverse(struct digraph *g, long i)
+{
+    long infinity = g->n + 2;
+    long nvert = 0, nframe = 0;
+    long x, y, top;
+    VALUE rp;
+
+    g->vertices[nvert++] = i;
+    g->index[i] = nvert;
+    g->frames[0] = i; g->frames[1] = nvert; g->frames[2] = 0;
+    nframe = 1;
+    while (nframe > 0) {
+        top = (nframe - 1) * 3;
+        x = g->frames[top];
+        rp = digraph_edges(g, x);
+        if (!NIL_P(rp) && g->frames[top + 2] < RARRAY_LEN(rp)) {
+            y = digraph_edge(g, rp, g->frames[top + 2]++);
+            if (g->index[y]) {
+                if (g->index[x] > g->index[y])
+                    g->index[x] = g->index[y];
+                set_or(g, x, y);
+            }
+            else {
+                g->vertices[nvert++] = y;
+                g->index[y] = nvert;
+                top += 3;
+                g->frames[top] = y;
+                g->frames[top + 1] = nvert;
+                g->frames[top + 2] = 0;
+                nframe++;
+            }
+            continue;
+        }
+        nframe--;
+        if (g->index[x] == g->frames[top + 1]) {
+            while (1) {
+                y = g->vertices[--nvert];
+                g->index[y] = infinity;
+                if (y == x) break;
+                set_or(g, y, x);
+            }
+        }
+        if (nframe > 0) {
+            y = g->frames[top - 3];
+            if (g->index[y] > g->index[x])
+                g->index[y] = g->index[x];
+            set_or(g, y, x);
+        }
+    }
+}
+
+static VALUE
+racc_digraph(VALUE mod, VALUE map, VALUE relation)
+{
+    struct digraph g;
+    VALUE bits_buf = 0, index_buf = 0, vert_buf = 0, frame_buf = 0;
+    VALUE v;
+    long i;
+    size_t w;
+
+    Check_Type(map, T_ARRAY);
+    Check_Type(relation, T_ARRAY);
+    g.n = RARRAY_LEN(relation);
+    if (RARRAY_LEN(map) < g.n)
+        rb_raise(rb_eArgError, "map is shorter than relation");
+    g.relation = relation;
+    g.nwords = 1;
+    for (i = 0; i < g.n; i++) {
+        v = rb_to_int(rb_ary_entry(map, i));
+        w = rb_absint_numwords(v, SET_WORD_BITS, NULL);
+        if ((long)w > g.nwords) g.nwords = w;
+    }
+
+    g.bits = ALLOCV_N(unsigned long, bits_buf, g.n * g.nwords);
+    g.index = ALLOCV_N(long, index_buf, g.n);
+    g.vertices = ALLOCV_N(long, vert_buf, g.n);
+    g.frames = ALLOCV_N(long, frame_buf, g.n * 3);
+    MEMZERO(g.index, long, g.n);
+    for (i = 0; i < g.n; i++) {
+        if (rb_integer_pack(rb_ary_entry(map, i), SET_ROW(&g, i), g.nwords,
+                            sizeof(unsigned long), 0, SET_PACK_FLAGS) < 0)
+            rb_raise(rb_eArgError, "negative bitmap");
+    }
+
+    for (i = 0; i < g.n; i++) {
+        if (!g.index[i] && !NIL_P(digraph_edges(&g, i)))
+            digraph_traverse(&g, i);
+    }
+
+    for (i = 0; i < g.n; i++) {
+        rb_ary_store(map, i,
+                     rb_integer_unpack(SET_ROW(&g, i), g.nwords,
+                                       sizeof(unsigned long), 0,
+                                       SET_PACK_FLAGS));
+    }
+    ALLOCV_END(frame_buf);
+    ALLOCV_END(vert_buf);
+    ALLOCV_END(index_buf);
+    ALLOCV_END(bits_buf);
+    return map;
+}
+
+/* Racc::Cparse.pack_table(entries, tbl, chk, ptr, check_base) packs the
+   rows of a sparse table like StateTransitionTableGenerator#set_table_rb:
+   each ENTRY is [row, check value, offset of row[0], index into PTR] and
+   is placed at the lowest position where none of its non-nil cells
+   collides with an earlier row (first fit).  On a collision the row moves
+   right to the next free slot for the colliding cell.  With CHECK_BASE,
+   every row gets its own base and CHK holds the base instead of the
+   check value. */
+
+static long
+next_free(VALUE used, long pos)
+{
+    const char *p = RSTRING_PTR(used);
+    const char *q = memchr(p + pos, 0, RSTRING_LEN(used) - pos);
+
+    if (!q)
+        rb_raise(RaccBug, "[Racc Bug] no free slot in table");
+    return q - p;
+}
+
+static VALUE
+racc_pack_table(VALUE mod, VALUE entries, VALUE tbl, VALUE chk, VALUE ptr,
+                VALUE check_base)
+{
+    VALUE used, bases, ent, row, chkval, cells_buf = 0;
+    long upper = 0, cap, n, ncells, idx, pos, min, maxmin = 0, i, j;
+    long *cells;
+    char *map;
+
+    Check_Type(entries, T_ARRAY);
+    Check_Type(tbl, T_ARRAY);
+    Check_Type(chk, T_ARRAY);
+    Check_Type(ptr, T_ARRAY);
+    for (i = 0; i < RARRAY_LEN(entries); i++) {
+        ent = rb_ary_entry(entries, i);
+        Check_Type(ent, T_ARRAY);
+        min = NUM2LONG(rb_ary_entry(ent, 2));
+        if (min < 0)
+            rb_raise(rb_eArgError, "negative row offset");
+        if (maxmin < min) maxmin = min;
+    }
+    cap = 10240;
+    used = rb_str_buf_new(cap);
+    rb_str_set_len(used, cap);
+    MEMZERO(RSTRING_PTR(used), char, cap);
+    /* bases[b + maxmin] is set when a row has the base b */
+    bases = rb_str_buf_new(cap + maxmin);
+    rb_str_set_len(bases, cap + maxmin);
+    MEMZERO(RSTRING_PTR(bases), char, cap + maxmin);
+
+    for (i = 0; i < RARRAY_LEN(entries); i++) {
+        ent = rb_ary_entry(entries, i);
+        row = rb_ary_entry(ent, 0);
+        Check_Type(row, T_ARRAY);
+        min = NUM2LONG(rb_ary_entry(ent, 2));
+        n = RARRAY_LEN(row);
+        /* a row never goes beyond upper plus one slot per earlier row */
+        if (upper + n + i + 1 >= cap) {
+            long newcap = upper + n + i + 1024;
+            rb_str_resize(used, newcap);
+            MEMZERO(RSTRING_PTR(used) + cap, char, newcap - cap);
+            rb_str_resize(bases, newcap + maxmin);
+            MEMZERO(RSTRING_PTR(bases) + cap + maxmin, char, newcap - cap);
+            cap = newcap;
+        }
+
+        cells = ALLOCV_N(long, cells_buf, n);
+        ncells = 0;
+        for (j = 0; j < n; j++) {
+            if (!NIL_P(rb_ary_entry(row, j)))
+                cells[ncells++] = j;
+        }
+
+        map = RSTRING_PTR(used);
+        idx = next_free(used, 0);
+        while (1) {
+            for (j = 0; j < ncells; ) {
+                pos = idx + cells[j];
+                if (map[pos]) {
+                    idx = next_free(used, pos) - cells[j];
+                    j = 0;
+                }
+                else {
+                    j++;
+                }
+            }
+            if (!RTEST(check_base) || !RSTRING_PTR(bases)[idx - min + maxmin])
+                break;
+            idx++;
+        }
+
+        if (RTEST(check_base)) {
+            RSTRING_PTR(bases)[idx - min + maxmin] = 1;
+            chkval = LONG2NUM(idx - min);
+        }
+        else {
+            chkval = rb_ary_entry(ent, 1);
+        }
+        for (j = 0; j < ncells; j++) {
+            pos = idx + cells[j];
+            rb_ary_store(tbl, pos, rb_ary_entry(row, cells[j]));
+            rb_ary_store(chk, pos, chkval);
+            map[pos] = 1;
+        }
+        rb_ary_store(ptr, NUM2LONG(rb_ary_entry(ent, 3)), LONG2NUM(idx - min));
+        if (upper < idx + n) upper = idx + n;
+        ALLOCV_END(cells_buf);
+    }
+    return Qnil;
+}
+
 /* -----------------------------------------------------------------------
                           Ruby Interface
 ----------------------------------------------------------------------- */
@@ -800,7 +2048,7 @@ Init_cparse(void)
     rb_ext_ractor_safe(true);
 #endif
 
-    VALUE Racc, Parser;
+    VALUE Racc, Parser, Cparse;
     ID id_racc = rb_intern_const("Racc");
 
     if (rb_const_defined(rb_cObject, id_racc)) {
@@ -812,12 +2060,21 @@ Init_cparse(void)
         Parser = rb_define_class_under(Racc, "Parser", rb_cObject);
     }
     rb_define_private_method(Parser, "_racc_do_parse_c", racc_cparse, 2);
+    rb_define_private_method(Parser, "_racc_do_parse_tokens_c",
+                             racc_cparse_tokens, 4);
     rb_define_private_method(Parser, "_racc_yyparse_c", racc_yyparse, 4);
+    rb_define_private_method(Parser, "_racc_push_start_c", racc_push_start, 2);
+    rb_define_private_method(Parser, "_racc_push_c", racc_push, 2);
+    rb_define_private_method(Parser, "_racc_push_result_c", racc_push_result, 0);
     rb_define_const(Parser, "Racc_Runtime_Core_Version_C",
                     rb_str_new2(RACC_VERSION));
     rb_define_const(Parser, "Racc_Runtime_Core_Id_C",
         rb_str_new2("$originalId: cparse.c,v 1.8 2006/07/06 11:39:46 aamine Exp $"));
 
+    Cparse = rb_define_module_under(Racc, "Cparse");
+    rb_define_module_function(Cparse, "digraph", racc_digraph, 2);
+    rb_define_module_function(Cparse, "pack_table", racc_pack_table, 5);
+
     CparseParams = rb_define_class_under(Racc, "CparseParams", rb_cObject);
     rb_undef_alloc_func(CparseParams);
     rb_undef_method(CparseParams, "initialize");
@@ -830,6 +2087,26 @@ Init_cparse(void)
     id_onerror      = rb_intern_const("on_error");
     id_noreduce     = rb_intern_const("_reduce_none");
     id_errstatus    = rb_intern_const("@racc_error_status");
+    id_collect_stats = rb_intern_const("@racc_collect_statistics");
+    id_statistics   = rb_intern_const("@racc_statistics");
+    id_trace_size   = rb_intern_const("@racc_trace_size");
+    id_trace_data   = rb_intern_const("@racc_trace_data");
+    id_trace_count  = rb_intern_const("@racc_trace_count");
+    id_tables       = rb_intern_const("__racc_tables__");
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+    /* Init_cparse runs in the main Ractor, the only one that has this key. */
+    main_ractor_key = rb_ractor_local_storage_value_newkey();
+    rb_ractor_local_storage_value_set(main_ractor_key, Qtrue);
+    ractor_tables_key = rb_ractor_local_storage_value_newkey();
+#endif
+    id_rule_flags   = rb_intern_const("Racc_rule_flags");
+    id_native_stack = rb_intern_const("Racc_native_stack");
+    id_positional_args = rb_intern_const("Racc_positional_args");
+    id_shared_action_rows = rb_intern_const("Racc_shared_action_rows");
+    id_push_params  = rb_intern_const("__racc_push_params__");
+    id_params       = rb_intern_const("__racc_params__");
+    id_push         = rb_intern_const("push");
+    id_unshift      = rb_intern_const("unshift");
 
     id_d_shift       = rb_intern_const("racc_shift");
     id_d_reduce      = rb_intern_const("racc_reduce");
@@ -5,4 +5,5 @@ require 'mkmf'
 require_relative '../../../lib/racc/info'
 
 $defs << "-D""RACC_INFO_VERSION=#{Racc::VERSION}"
+have_func('rb_gc_mark_movable')   # GC compaction, Ruby 2.7+
 create_makefile 'racc/cparse'
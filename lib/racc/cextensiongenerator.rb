@@ -0,0 +1,121 @@
+require_relative 'info'
+
+module Racc
+
+  # Writes the state transition tables of a parser as a C extension, in
+  # which they are static const arrays.  The extension exposes each table
+  # as a frozen String in the format of the packed_tables option, which
+  # points to the array itself; the parser file generated with the same
+  # params requires the extension and takes its tables from there.
+  class CExtensionGenerator
+
+    TABLES = %w[
+      racc_action_table racc_action_check racc_action_pointer
+      racc_action_default racc_goto_table racc_goto_check
+      racc_goto_pointer racc_goto_default
+    ]
+
+    # The name of the module defining the tables of the extension FEATURE.
+    def CExtensionGenerator.module_name(feature)
+      'Racc::CTables::' + feature.split('_').map(&:capitalize).join
+    end
+
+    def initialize(states, params)
+      @states = states
+      @params = params
+      @feature = params.c_extension
+    end
+
+    # Writes <feature>.c and extconf.rb into DIR.
+    def generate(dir)
+      Dir.mkdir dir unless File.directory?(dir)
+      File.write File.join(dir, "#{@feature}.c"), source
+      File.write File.join(dir, 'extconf.rb'), extconf
+    end
+
+    def source
+      table = @states.state_transition_table(**@params.table_options)
+      out = +''
+      out << <<~C
+        /*
+            DO NOT MODIFY!!!!
+            This file is automatically generated by Racc #{Racc::Version}
+            from Racc grammar file "#{@params.filename}".
+        */
+
+        #include <ruby.h>
+
+        #define RACC_NIL INT32_MIN   /* nil of the tables */
+
+      C
+      TABLES.each do |name|
+        out << array(name, table.__send__(name.delete_prefix('racc_')))
+        out << "\n"
+      end
+      out << <<~C
+        /* The table as a String of little endian int32s, shared with the
+           array unless the host is big endian. */
+        static VALUE
+        packed_table(const int32_t *table, long len)
+        {
+        #ifdef WORDS_BIGENDIAN
+            VALUE str = rb_str_new(NULL, len * 4);
+            unsigned char *p = (unsigned char *)RSTRING_PTR(str);
+            long i;
+
+            for (i = 0; i < len; i++) {
+                uint32_t n = (uint32_t)table[i];
+                p[i*4]   = n & 0xff;
+                p[i*4+1] = (n >> 8) & 0xff;
+                p[i*4+2] = (n >> 16) & 0xff;
+                p[i*4+3] = (n >> 24) & 0xff;
+            }
+            return rb_obj_freeze(str);
+        #else
+            return rb_obj_freeze(rb_str_new_static((const char *)table,
+                                                   len * sizeof(int32_t)));
+        #endif
+        }
+
+        void
+        Init_#{@feature}(void)
+        {
+            VALUE mod = rb_define_module("Racc");
+
+        #ifdef HAVE_RB_EXT_RACTOR_SAFE
+            rb_ext_ractor_safe(true);
+        #endif
+      C
+      CExtensionGenerator.module_name(@feature).split('::').drop(1).each do |name|
+        out << %Q[    mod = rb_define_module_under(mod, "#{name}");\n]
+      end
+      TABLES.each do |name|
+        len = table.__send__(name.delete_prefix('racc_')).size
+        out << %Q[    rb_define_const(mod, "#{name.upcase}", packed_table(#{name}, #{len}));\n]
+      end
+      out << "}\n"
+    end
+
+    def extconf
+      <<~RUBY
+        # This file is automatically generated by Racc #{Racc::Version}
+        # from Racc grammar file "#{@params.filename}".
+
+        require 'mkmf'
+        have_func 'rb_ext_ractor_safe', 'ruby.h'
+        create_makefile '#{@feature}'
+      RUBY
+    end
+
+    private
+
+    def array(name, table)
+      nums = table.map {|n| n ? n.to_s : 'RACC_NIL' }
+      nums = ['0'] if nums.empty?   # no empty initializer in C
+      rows = nums.each_slice(10).map {|ns| '    ' + ns.map {|n| n.rjust(8) }.join(',') }
+      "static const int32_t #{name}[] = {\n#{rows.join(",\n")}\n};\n"
+    end
+
+  end
+
+end
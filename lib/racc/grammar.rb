@@ -499,13 +499,13 @@ module Racc
     # Sym#expand
     def compute_expand(t)
       puts "expand> #{t.to_s}" if @debug_symbol
-      t.expand = _compute_expand(t, ISet.new, [])
-      puts "expand< #{t.to_s}: #{t.expand.to_s}" if @debug_symbol
+      t.expand = _compute_expand(t, ISet.new, []).to_a
+      puts "expand< #{t.to_s}: [#{t.expand.join(' ')}]" if @debug_symbol
     end
 
     def _compute_expand(t, set, lock)
       if tmp = t.expand
-        set.update tmp
+        set.update_a tmp
         return set
       end
       tok = nil
@@ -723,13 +723,38 @@ module Racc
       @symbols = @symbols.map {|s| s == src ? dest : s }
     end
 
+    # Actions which the runtime executes by itself instead of calling
+    # a method, and the code of that method for runtimes which don't.
+    # _racc_builtin_valN returns val[N].
+    BUILTIN_ACTIONS = {
+      :_racc_builtin_nil     => 'nil',
+      :_racc_builtin_array   => 'val',
+      :_racc_builtin_append  => 'val[0].push(val[-1])',
+      :_racc_builtin_prepend => 'val[1] ? val[1].unshift(val[0]) : val'
+    }
+
+    def Rule.builtin_action_source(mid)
+      if n = mid.to_s[/\A_racc_builtin_val(\d+)\z/, 1]
+        "val[#{n}]"
+      else
+        BUILTIN_ACTIONS.fetch(mid)
+      end
+    end
+
+    # Returns the name of the built-in action recorded for the rules
+    # generated for `*', `+' and groups, or nil.  Hand-written actions are
+    # always called as they are, even when they read like a built-in one.
+    def builtin_action
+      @action.source? ? @action.builtin : nil
+    end
+
   end   # class Rule
 
 
   class UserAction
 
-    def UserAction.source_text(src)
-      new(src, nil)
+    def UserAction.source_text(src, builtin = nil)
+      new(src, nil, builtin)
     end
 
     def UserAction.proc(pr = nil, &block)
@@ -745,13 +770,15 @@ module Racc
 
     private_class_method :new
 
-    def initialize(src, proc)
+    def initialize(src, proc, builtin = nil)
       @source = src
       @proc = proc
+      @builtin = builtin
     end
 
     attr_reader :source
     attr_reader :proc
+    attr_reader :builtin   # built-in action doing the same as the source
 
     def source?
       not @proc
@@ -66,6 +66,38 @@ module Racc
                           @result.params.omit_action_call = true
                         when 'no_omit_action_call'
                           @result.params.omit_action_call = false
+                        when 'native_stack'
+                          @result.params.native_stack = true
+                        when 'no_native_stack'
+                          @result.params.native_stack = false
+                        when 'positional_args'
+                          @result.params.positional_args = true
+                        when 'no_positional_args'
+                          @result.params.positional_args = false
+                        when 'token_constants'
+                          @result.params.token_constants = true
+                        when 'no_token_constants'
+                          @result.params.token_constants = false
+                        when 'skip_unit_rules'
+                          @result.params.skip_unit_rules = true
+                        when 'no_skip_unit_rules'
+                          @result.params.skip_unit_rules = false
+                        when 'share_action_rows'
+                          @result.params.share_action_rows = true
+                        when 'no_share_action_rows'
+                          @result.params.share_action_rows = false
+                        when 'packed_tables'
+                          @result.params.packed_tables = true
+                        when 'no_packed_tables'
+                          @result.params.packed_tables = false
+                        when 'ruby_parse_loop'
+                          @result.params.ruby_parse_loop = true
+                        when 'no_ruby_parse_loop'
+                          @result.params.ruby_parse_loop = false
+                        when 'direct_action_calls'
+                          @result.params.direct_action_calls = true
+                        when 'no_direct_action_calls'
+                          @result.params.direct_action_calls = false
                         else
                           raise CompileError, "unknown option: #{opt}"
                         end
@@ -296,7 +328,7 @@ module Racc
       target = _gen_target_name("many", prev)
       @many_rule_registry[prev.to_s] = target
       src = SourceText.new("result = val[1] ? val[1].unshift(val[0]) : val", @filename, @scanner.lineno + 1)
-      act = UserAction.source_text(src)
+      act = UserAction.source_text(src, :_racc_builtin_prepend)
       @grammar.add Rule.new(target, [], act)
       @grammar.add Rule.new(target, [prev, target], act)
       target
@@ -309,7 +341,7 @@ module Racc
       target = _gen_target_name("many1", prev)
       @many1_rule_registry[prev.to_s] = target
       src = SourceText.new("result = val[1] ? val[1].unshift(val[0]) : val", @filename, @scanner.lineno + 1)
-      act = UserAction.source_text(src)
+      act = UserAction.source_text(src, :_racc_builtin_prepend)
       @grammar.add Rule.new(target, [prev], act)
       @grammar.add Rule.new(target, [prev, target], act)
       target
@@ -324,7 +356,7 @@ module Racc
         target = @grammar.intern("-group@#{target_name}", true)
         @group_rule_registry[target_name] = target
         src = SourceText.new("result = val", @filename, @scanner.lineno + 1)
-        act = UserAction.source_text(src)
+        act = UserAction.source_text(src, :_racc_builtin_array)
         rules.each do |syms, sprec|
           rule = Rule.new(target, syms, act)
           rule.specified_prec = sprec
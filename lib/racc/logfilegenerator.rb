@@ -118,7 +118,9 @@ module Racc
       rr.each {|tok, c| outrrconf f, c } if rr
 
       act = state.defact
-      if not act.kind_of?(Error) or @debug_flags.any?
+      if state.default_reduction?
+        outact f, '$default', act, ' without lookahead'
+      elsif not act.kind_of?(Error) or @debug_flags.any?
         outact f, '$default', act
       end
 
@@ -130,14 +132,14 @@ module Racc
       end
     end
 
-    def outact(f, t, act)
+    def outact(f, t, act, note = '')
       case act
       when Shift
         f.printf "  %-12s  shift, and go to state %d\n",
                  t.to_s, act.goto_id
       when Reduce
-        f.printf "  %-12s  reduce using rule %d (%s)\n",
-                 t.to_s, act.ruleid, act.rule.target.to_s
+        f.printf "  %-12s  reduce using rule %d (%s)%s\n",
+                 t.to_s, act.ruleid, act.rule.target.to_s, note
       when Accept
         f.printf "  %-12s  accept\n", t.to_s
       when Error
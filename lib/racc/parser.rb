@@ -35,15 +35,29 @@ end
 #          [--line-convert-all]
 #          [-l] [--no-line-convert]
 #          [-a] [--no-omit-actions]
+#          [--native-stack]
+#          [--positional-args]
+#          [--token-constants]
+#          [--skip-unit-rules]
+#          [--share-action-rows]
+#          [--packed-tables]
+#          [--ruby-parse-loop]
+#          [--direct-action-calls]
+#          [--c-extension=<var>dir</var>]
+#          [--cache-dir=<var>dir</var>]
 #          [--superclass=<var>classname</var>]
+#          [--sentence=<var>length</var>] [--seed=<var>n</var>]
 #          [-C] [--check-only]
 #          [-S] [--output-status]
 #          [-P]
+#          [-j<var>n</var>] [--jobs=<var>n</var>]
 #          [-D<var>flags</var>]
-#          [--version] [--runtime-version] [--copyright] [--help] <var>grammarfile</var>
+#          [--version] [--runtime-version] [--copyright] [--help] <var>grammarfile</var>...
 #
 # [+grammarfile+]
-#   Racc grammar file. Any extension is permitted.
+#   Racc grammar file. Any extension is permitted.  Several grammar files
+#   may be given, each compiled to its own parser file; -o and -O cannot
+#   be used then.
 # [-o+outfile+, --output-file=+outfile+]
 #   A filename for output. default is <+filename+>.tab.rb
 # [-t, --debug]
@@ -68,14 +82,80 @@ end
 #   Turns off line number converting.
 # [-a, --no-omit-actions]
 #   Call all actions, even if an action is empty.
+# [--native-stack]
+#   Keep the parser's value stack in a C array (C runtime only).
+#   +_values+ is then a read-only copy, which is only built for actions
+#   that mention it, and +@vstack+ is not set.
+# [--positional-args]
+#   Pass the right hand side values to each action as separate arguments
+#   instead of building a +val+ Array for every reduction.  <tt>val[N]</tt>
+#   in an action is rewritten to refer to the N-th argument; +val+ itself
+#   is only built for actions that still use it.  The parser refuses to
+#   load on older runtimes.
+# [--token-constants]
+#   Define the terminal ids as constants of a Tokens module in the parser
+#   class, e.g. MyParser::Tokens::IDENT.  #next_token may return them
+#   instead of token symbols.  The JRuby runtime cannot run the parser.
+# [--skip-unit-rules]
+#   Let the goto table jump over reductions by unit rules without action
+#   (e.g. <tt>expr: term</tt>), which only pass their value through.
+#   The result of the parse is the same, but such reductions no longer
+#   show up in the debug output.
+# [--share-action-rows]
+#   Store the actions of states which act the same on every token only
+#   once in the action table.  This makes the table smaller, but older
+#   runtimes and the JRuby runtime cannot run the parser.
+# [--packed-tables]
+#   Write the state transition tables as packed binary strings instead of
+#   Array literals.  The parser file is smaller and loads faster, but
+#   older runtimes cannot run the parser.
+# [--ruby-parse-loop]
+#   Generate a parse loop specialized for the grammar, which the Ruby
+#   runtime (used when the C extension is not available) runs instead of
+#   interpreting the tables.  The action and goto tables become +case+
+#   statements on the token and state numbers, and reductions call their
+#   actions directly.  The loop is used by #do_parse and
+#   #do_parse_tokens; #yyparse, the push parser, debug output,
+#   statistics and traces use the generic one, as does error recovery.
+#   The parser file grows with the number of states.  The loop calls the
+#   actions in a +catch+ for yyerror and yyaccept unless
+#   --direct-action-calls is given.
+# [--direct-action-calls]
+#   Call the actions which do not mention yyerror, yyaccept nor yyerrok
+#   without catching the jumps of these methods, which saves a +catch+
+#   per reduction.  Only use it when no method called by the actions
+#   may call them either: the jump would then escape the parser as an
+#   UncaughtThrowError.
+# [--c-extension=+dir+]
+#   Write the state transition tables as static arrays of a C extension,
+#   <+filename+>_tables.c with its extconf.rb, into +dir+.  The parser
+#   file requires the extension and takes the tables from it, in the
+#   format of --packed-tables, without building any Ruby object for them
+#   but a String pointing to the array.
+# [--cache-dir=+dir+]
+#   Save the state transition tables in +dir+, and reuse them while the
+#   rules and the precedence of the grammar stay the same, as they do
+#   when only the user code or the body of an action changes.  The cache
+#   is not used with -v or -D.
 # [--superclass=+classname+]
 #   Uses +classname+ instead of Racc::Parser as the superclass of the generated parser.
+# [--sentence=+length+]
+#   Write a random sentence of the grammar, about +length+ tokens long,
+#   instead of the parser, to <+filename+>.sentence or the -o file.  The
+#   file holds the terminal ids packed as native int32s, which
+#   Racc::Parser#do_parse_tokens takes as they are:
+#   <tt>parser.do_parse_tokens(File.binread(path), [])</tt>.
+#   See Racc::SentenceGenerator.
+# [--seed=+n+]
+#   Use +n+ as the seed of the random sentence.
 # [-C, --check-only]
 #   Check syntax of racc grammar file and quit.
 # [-S, --output-status]
 #   Print messages time to time while compiling.
 # [-P]
 #   Enables generator profile mode.
+# [-j+n+, --jobs=+n+]
+#   Compile up to +n+ grammar files at a time, in forked processes.
 # [-D +flags+]
 #   Do not use this option. Flags for Racc debugging.
 # [--version]
@@ -142,6 +222,12 @@ end
 # For example, <code>yyparse(obj, :scan)</code> causes
 # calling +obj#scan+, and you can return tokens by yielding them from +obj#scan+.
 #
+# The parser asks for a token only when the current state needs one to
+# choose its action.  A state which can only reduce by one rule reduces
+# at once, so the action of a statement ending with ';' runs before the
+# token after ';' is requested.  The log file (-v) marks these states
+# with "without lookahead".
+#
 # == Debugging
 #
 # When debugging, "-v" or/and the "-t" option is helpful.
@@ -153,6 +239,12 @@ end
 # You must use -t option and set +@yydebug+ to +true+ in order to get output.
 # -t option only creates the verbose parser.
 #
+# To find the rules and states an input keeps the parser busy with, set
+# +racc_collect_statistics+ of the parser instead; any parser counts its
+# tokens, shifts and reductions then, see Racc::Parser#racc_statistics.
+# Likewise +racc_trace_size+ keeps the last steps of each parse for
+# Racc::Parser#racc_trace, to look at after a parse failed.
+#
 # === Racc reported syntax error.
 #
 # Isn't there too many "end"?
@@ -221,17 +313,65 @@ module Racc
       Racc_YY_Parse_Method         = :_racc_yyparse_c # :nodoc:
       Racc_Runtime_Core_Version    = Racc_Runtime_Core_Version_C # :nodoc:
       Racc_Runtime_Type            = 'c' # :nodoc:
+      Racc_Token_Buffer_Routine    = # :nodoc:
+        if new.respond_to?(:_racc_do_parse_tokens_c, true)
+          :_racc_do_parse_tokens_c
+        else
+          :_racc_do_parse_tokens_rb
+        end
+      Racc_Push_Core               = # :nodoc:
+        new.respond_to?(:_racc_push_c, true) ? 'c' : 'rb'
+      Racc_Packed_Tables_Core      = # :nodoc:
+        if RUBY_ENGINE != 'jruby' and Racc_Token_Buffer_Routine == :_racc_do_parse_tokens_c and
+           Racc_Push_Core == 'c'
+          'c'
+        else
+          'rb'
+        end
     rescue LoadError
       Racc_Main_Parsing_Routine    = :_racc_do_parse_rb
       Racc_YY_Parse_Method         = :_racc_yyparse_rb
       Racc_Runtime_Core_Version    = Racc_Runtime_Core_Version_R
       Racc_Runtime_Type            = 'ruby'
+      Racc_Token_Buffer_Routine    = :_racc_do_parse_tokens_rb
+      Racc_Push_Core               = 'rb'
+      Racc_Packed_Tables_Core      = 'rb'
     end
 
+    # Generated parsers which older runtimes would misread check that
+    # these are defined when they are loaded.
+    Racc_Positional_Args_Core = Racc_Runtime_Type # :nodoc:
+    Racc_Shared_Action_Rows_Core = Racc_Runtime_Type # :nodoc:
+
+    # Bits of Racc_rule_flags in generated parsers.
+    Racc_Rule_Uses_Values = 0x01 # :nodoc:
+    Racc_Rule_No_Jump     = 0x02 # :nodoc:
+
+    # Stands for nil in the tables written by the packed_tables option.
+    Racc_Packed_Nil = -0x80000000 # :nodoc:
+
     def Parser.racc_runtime_type # :nodoc:
       Racc_Runtime_Type
     end
 
+    # Racc_arg with the tables written by the packed_tables option
+    # unpacked into Arrays.  The C runtime reads the packed Strings as
+    # they are; the others unpack them once per parser class.  Other
+    # Ractors than the main one may not set the instance variable, and
+    # unpack them again unless the parser file has done it at load time.
+    def Parser.racc_unpacked_arg # :nodoc:
+      return @racc_unpacked_arg if @racc_unpacked_arg
+      arg = self::Racc_arg.each_with_index.map {|t, i|
+        next t unless i < 8 and String === t
+        t.unpack('l<*').map! {|n| n == Racc_Packed_Nil ? nil : n }.freeze
+      }.freeze
+      if defined?(Ractor)
+        Ractor.make_shareable(arg)
+        return arg unless Ractor.current == Ractor.main
+      end
+      @racc_unpacked_arg = arg
+    end
+
     def _racc_setup
       @yydebug = false unless self.class::Racc_debug_parser
       @yydebug = false unless defined?(@yydebug)
@@ -239,12 +379,49 @@ module Racc
         @racc_debug_out = $stderr unless defined?(@racc_debug_out)
         @racc_debug_out ||= $stderr
       end
+      @racc_positional_args = self.class.const_defined?(:Racc_positional_args) &&
+                              self.class::Racc_positional_args
+      @racc_rule_flags = self.class.const_defined?(:Racc_rule_flags) &&
+                         self.class::Racc_rule_flags
+      # With shared action rows, action_check holds the base of the row
+      # (action_pointer) rather than the state.
+      @racc_check_base = self.class.const_defined?(:Racc_shared_action_rows) &&
+                         self.class::Racc_shared_action_rows
+      if RUBY_ENGINE == 'jruby' and Racc_Runtime_Type == 'c'
+        # The JRuby runtime would read the Integer ids of the Tokens
+        # module as unknown tokens.
+        if self.class.const_defined?(:Racc_token_constants) and
+           self.class::Racc_token_constants
+          raise NotImplementedError,
+                "#{self.class}: token_constants is not supported by the JRuby runtime"
+        end
+        if @racc_positional_args
+          raise NotImplementedError,
+                "#{self.class}: positional_args is not supported by the JRuby runtime"
+        end
+        if @racc_check_base
+          raise NotImplementedError,
+                "#{self.class}: share_action_rows is not supported by the JRuby runtime"
+        end
+        if @racc_collect_statistics
+          raise NotImplementedError,
+                "#{self.class}: statistics are not supported by the JRuby runtime"
+        end
+        if @racc_trace_size
+          raise NotImplementedError,
+                "#{self.class}: tracing is not supported by the JRuby runtime"
+        end
+      end
+      @racc_trace_ring = @racc_trace_data = nil
       arg = self.class::Racc_arg
       arg[13] = true if arg.size < 14
+      if String === arg[0] and Racc_Packed_Tables_Core == 'rb'
+        arg = self.class.racc_unpacked_arg
+      end
       arg
     end
 
-    def _racc_init_sysvars
+    def _racc_init_sysvars(arg)
       @racc_state  = [0]
       @racc_tstack = []
       @racc_vstack = []
@@ -256,6 +433,52 @@ module Racc
 
       @racc_user_yyerror = false
       @racc_error_status = 0
+      @racc_int_tokens = nil
+
+      @racc_statistics = nil
+      if defined?(@racc_collect_statistics) and @racc_collect_statistics
+        @racc_statistics = {
+          tokens: 0,
+          shifts: 0,
+          reductions: Array.new(arg[9].size / 3, 0),
+          states: Array.new(arg[3].size, 0),
+          errors: 0,
+          max_depth: 0
+        }
+        _racc_count_state
+      end
+      if defined?(@racc_trace_size) and @racc_trace_size and @racc_trace_size > 0
+        @racc_trace_ring = Array.new(@racc_trace_size * 4, 0)
+        @racc_trace_count = 0
+      end
+    end
+
+    # Counts the visit of the state on top of the stack.
+    def _racc_count_state
+      stats = @racc_statistics
+      stats[:states][@racc_state[-1]] += 1
+      stats[:max_depth] = @racc_state.size if @racc_state.size > stats[:max_depth]
+    end
+
+    # Records an event in the state the parser is in after it.
+    def _racc_trace(kind, tok, rule)
+      ring = @racc_trace_ring
+      i = @racc_trace_count % (ring.size / 4) * 4
+      ring[i]     = kind
+      ring[i + 1] = @racc_state[-1]
+      ring[i + 2] = tok
+      ring[i + 3] = rule
+      @racc_trace_count += 1
+    end
+
+    # Returns TOK itself if it is a terminal id, e.g. Tokens::IDENT.
+    # That is not possible when some token in TOKEN_TABLE is an Integer.
+    def _racc_int_token(tok, token_table, nt_base)
+      return nil unless Integer === tok and tok >= 0 and tok < nt_base
+      if @racc_int_tokens.nil?
+        @racc_int_tokens = token_table.each_key.none? {|t| Integer === t }
+      end
+      @racc_int_tokens ? tok : nil
     end
 
     # The entry point of the parser. This method is used with #next_token.
@@ -286,17 +509,50 @@ module Racc
     # +token-symbol+ is represented by Ruby's symbol by default, e.g. :IDENT
     # for 'IDENT'.  ";" (String) for ';'.
     #
+    # +token-symbol+ may also be the Integer id of the terminal, e.g.
+    # MyParser::Tokens::IDENT when the parser was generated with
+    # --token-constants.  This saves converting the token by a Hash lookup,
+    # but is not possible when a "convert" block maps tokens to Integers.
+    #
     # The final symbol (End of file) must be false.
     def next_token
       raise NotImplementedError, "#{self.class}\#next_token is not defined"
     end
 
+    # The entry point of the parser for input which is already scanned.
+    # TYPES and VALUES are the tokens and their values, as #next_token
+    # would return them one by one; the end of TYPES is the end of input.
+    # TYPES may also be a String of terminal ids (see
+    # --token-constants) packed as native int32s, i.e. <tt>ids.pack('l*')</tt>.
+    #
+    # Example:
+    #     def parse(src)
+    #       types, values = MyScanner.scan(src)
+    #       do_parse_tokens(types, values)
+    #     end
+    class_eval <<~RUBY, __FILE__, __LINE__ + 1
+    def do_parse_tokens(types, values)
+      #{Racc_Token_Buffer_Routine}(_racc_setup(), types, values, false)
+    end
+    RUBY
+
+    def _racc_do_parse_tokens_rb(arg, types, values, in_debug)
+      types = types.unpack('l*') if String === types
+      tokens = Enumerator.new {|y|
+        types.each_with_index do |tok, i|
+          y.yield tok, values[i]
+        end
+        y.yield false, '$'
+      }
+      _racc_yyparse_rb(tokens, :each, arg, in_debug)
+    end
+
     def _racc_do_parse_rb(arg, in_debug)
       action_table, action_check, action_default, action_pointer,
       _,            _,            _,              _,
-      _,            _,            token_table,    * = arg
+      nt_base,      _,            token_table,    * = arg
 
-      _racc_init_sysvars
+      _racc_init_sysvars(arg)
       tok = act = i = nil
 
       catch(:racc_end_parse) {
@@ -308,8 +564,12 @@ module Racc
                 unless tok      # EOF
                   @racc_t = 0
                 else
-                  @racc_t = (token_table[tok] or 1)   # error token
+                  @racc_t = (token_table[tok] or
+                             _racc_int_token(tok, token_table, nt_base) or
+                             1)   # error token
+                  @racc_statistics[:tokens] += 1 if @racc_statistics
                 end
+                _racc_trace ParseTrace::READ, @racc_t, -1 if @racc_trace_ring
                 racc_read_token(@racc_t, tok, @racc_val) if @yydebug
                 @racc_read_next = false
               end
@@ -317,7 +577,7 @@ module Racc
             i += @racc_t
             unless i >= 0 and
                    act = action_table[i] and
-                   action_check[i] == @racc_state[-1]
+                   action_check[i] == (@racc_check_base ? i - @racc_t : @racc_state[-1])
               act = action_default[@racc_state[-1]]
             end
           else
@@ -330,6 +590,32 @@ module Racc
       }
     end
 
+    # True if the parse loop generated by the ruby_parse_loop option may
+    # run the parse.  Debug output, statistics and traces are left to the
+    # generic loop above.
+    def _racc_parse_loop?
+      not @yydebug and
+        not (defined?(@racc_collect_statistics) and @racc_collect_statistics) and
+        not (defined?(@racc_trace_size) and @racc_trace_size and @racc_trace_size > 0)
+    end
+
+    # Goes on from an action called by the generated parse loop which
+    # threw CODE to :racc_jump (yyerror or yyaccept).
+    def _racc_parse_loop_jump(code, arg)
+      case code
+      when 1 # yyerror
+        @racc_user_yyerror = true
+        act = -arg[12]   # reduce_n
+      when 2 # yyaccept
+        act = arg[11]    # shift_n
+      else
+        raise '[Racc Bug] unknown jump code'
+      end
+      while act = _racc_evalact(act, arg)
+        ;
+      end
+    end
+
     # Another entry point for the parser.
     # If you use this method, you must implement RECEIVER#METHOD_ID method.
     #
@@ -342,52 +628,127 @@ module Racc
     RUBY
 
     def _racc_yyparse_rb(recv, mid, arg, c_debug)
+      _racc_init_sysvars(arg)
+
+      catch(:racc_end_parse) {
+        i = _racc_yyparse_first(arg)
+        recv.__send__(mid) do |tok, val|
+          i = _racc_yyparse_next(arg, i, tok, val)
+        end
+      }
+    end
+
+    # Reduces until the parser needs a token, and returns the index of
+    # the action table for the current state.
+    def _racc_yyparse_first(arg)
+      _, _, action_default, action_pointer, * = arg
+
+      until i = action_pointer[@racc_state[-1]]
+        while act = _racc_evalact(action_default[@racc_state[-1]], arg)
+          ;
+        end
+      end
+      i
+    end
+
+    # Processes the token TOK and its value VAL.  I is the value returned
+    # by _racc_yyparse_first or the previous call of this method.
+    def _racc_yyparse_next(arg, i, tok, val)
       action_table, action_check, action_default, action_pointer,
       _,            _,            _,              _,
-      _,            _,            token_table,    * = arg
+      nt_base,      _,            token_table,    * = arg
 
-      _racc_init_sysvars
+      unless tok
+        @racc_t = 0
+      else
+        @racc_t = (token_table[tok] or
+                   _racc_int_token(tok, token_table, nt_base) or
+                   1)   # error token
+        @racc_statistics[:tokens] += 1 if @racc_statistics
+      end
+      _racc_trace ParseTrace::READ, @racc_t, -1 if @racc_trace_ring
+      @racc_val = val
+      @racc_read_next = false
 
-      catch(:racc_end_parse) {
-        until i = action_pointer[@racc_state[-1]]
-          while act = _racc_evalact(action_default[@racc_state[-1]], arg)
-            ;
-          end
+      i += @racc_t
+      unless i >= 0 and
+             act = action_table[i] and
+             action_check[i] == (@racc_check_base ? i - @racc_t : @racc_state[-1])
+        act = action_default[@racc_state[-1]]
+      end
+      while act = _racc_evalact(act, arg)
+        ;
+      end
+
+      while !(i = action_pointer[@racc_state[-1]]) ||
+            ! @racc_read_next ||
+            @racc_t == 0  # $
+        unless i and i += @racc_t and
+               i >= 0 and
+               act = action_table[i] and
+               action_check[i] == (@racc_check_base ? i - @racc_t : @racc_state[-1])
+          act = action_default[@racc_state[-1]]
         end
-        recv.__send__(mid) do |tok, val|
-          unless tok
-            @racc_t = 0
-          else
-            @racc_t = (token_table[tok] or 1)   # error token
-          end
-          @racc_val = val
-          @racc_read_next = false
+        while act = _racc_evalact(act, arg)
+          ;
+        end
+      end
+      i
+    end
 
-          i += @racc_t
-          unless i >= 0 and
-                 act = action_table[i] and
-                 action_check[i] == @racc_state[-1]
-            act = action_default[@racc_state[-1]]
-          end
-          while act = _racc_evalact(act, arg)
-            ;
-          end
+    # Returns a PushParser which feeds tokens to a new instance of this
+    # class.  ARGS are passed to +new+.
+    def Parser.push_parser(*args, &block)
+      new(*args, &block).push_parser
+    end
+    if respond_to?(:ruby2_keywords, true)
+      singleton_class.__send__(:ruby2_keywords, :push_parser)
+    end
 
-          while !(i = action_pointer[@racc_state[-1]]) ||
-                ! @racc_read_next ||
-                @racc_t == 0  # $
-            unless i and i += @racc_t and
-                   i >= 0 and
-                   act = action_table[i] and
-                   action_check[i] == @racc_state[-1]
-              act = action_default[@racc_state[-1]]
-            end
-            while act = _racc_evalact(act, arg)
-              ;
-            end
-          end
-        end
+    # Returns a PushParser which feeds tokens to this parser.
+    def push_parser
+      PushParser.new(self)
+    end
+
+    class_eval <<~RUBY, __FILE__, __LINE__ + 1
+    def _racc_push_start
+      _racc_push_start_#{Racc_Push_Core}(_racc_setup(), false)
+    end
+
+    def _racc_push(tok, val)
+      _racc_push_#{Racc_Push_Core}(tok, val)
+    end
+
+    def _racc_push_result
+      _racc_push_result_#{Racc_Push_Core}()
+    end
+    RUBY
+
+    def _racc_push_start_rb(arg, in_debug)
+      _racc_init_sysvars(arg)
+      @racc_push_arg = arg
+      @racc_push_fin = true
+      @racc_push_result = catch(:racc_end_parse) {
+        @racc_push_i = _racc_yyparse_first(arg)
+        @racc_push_fin = false
+        nil
       }
+      @racc_push_fin
+    end
+
+    def _racc_push_rb(tok, val)
+      @racc_push_fin = true
+      @racc_push_result = catch(:racc_end_parse) {
+        @racc_push_i = _racc_yyparse_next(@racc_push_arg, @racc_push_i,
+                                          tok, val)
+        @racc_push_fin = false
+        nil
+      }
+      @racc_push_fin
+    end
+
+    def _racc_push_result_rb
+      @racc_push_result
     end
 
     ###
@@ -411,6 +772,11 @@ module Racc
         @racc_vstack.push @racc_val
         @racc_state.push act
         @racc_read_next = true
+        if @racc_statistics
+          @racc_statistics[:shifts] += 1
+          _racc_count_state
+        end
+        _racc_trace ParseTrace::SHIFT, @racc_t, -1 if @racc_trace_ring
         if @yydebug
           @racc_tstack.push @racc_t
           racc_shift @racc_t, @racc_tstack, @racc_vstack
@@ -420,10 +786,18 @@ module Racc
         #
         # reduce
         #
-        code = catch(:racc_jump) {
+        @racc_statistics[:reductions][-act] += 1 if @racc_statistics
+        flags = @racc_rule_flags
+        if flags and flags[-act] & Racc_Rule_No_Jump != 0
+          # the action never calls yyerror nor yyaccept
+          code = nil
           @racc_state.push _racc_do_reduce(arg, act)
-          false
-        }
+        else
+          code = catch(:racc_jump) {
+            @racc_state.push _racc_do_reduce(arg, act)
+            false
+          }
+        end
         if code
           case code
           when 1 # yyerror
@@ -435,11 +809,14 @@ module Racc
             raise '[Racc Bug] unknown jump code'
           end
         end
+        _racc_count_state if @racc_statistics
+        _racc_trace ParseTrace::REDUCE, -1, -act if @racc_trace_ring
 
       elsif act == shift_n
         #
         # accept
         #
+        _racc_trace ParseTrace::ACCEPT, -1, -1 if @racc_trace_ring
         racc_accept if @yydebug
         throw :racc_end_parse, @racc_vstack[0]
 
@@ -447,10 +824,12 @@ module Racc
         #
         # error
         #
+        _racc_trace ParseTrace::ERROR, @racc_t, -1 if @racc_trace_ring
         case @racc_error_status
         when 0
           unless arg[21]    # user_yyerror
             nerr += 1
+            @racc_statistics[:errors] += 1 if @racc_statistics
             on_error @racc_t, @racc_val, @racc_vstack
           end
         when 3
@@ -468,13 +847,14 @@ module Racc
             i += 1   # error token
             if  i >= 0 and
                 (act = action_table[i]) and
-                action_check[i] == @racc_state[-1]
+                action_check[i] == (@racc_check_base ? i - 1 : @racc_state[-1])
               break
             end
           end
           throw :racc_end_parse, nil if @racc_state.size <= 1
           @racc_state.pop
           @racc_vstack.pop
+          _racc_trace ParseTrace::POP, -1, -1 if @racc_trace_ring
           if @yydebug
             @racc_tstack.pop
             racc_e_pop @racc_state, @racc_tstack, @racc_vstack
@@ -514,7 +894,15 @@ module Racc
       state[-len, len]  = void_array
 
       # tstack must be updated AFTER method call
-      if use_result
+      if @racc_positional_args
+        if method_id == :_reduce_none
+          vstack.push tmp_v[0]
+        elsif use_result
+          vstack.push __send__(method_id, *tmp_v, vstack, tmp_v[0])
+        else
+          vstack.push __send__(method_id, *tmp_v, vstack)
+        end
+      elsif use_result
         vstack.push __send__(method_id, tmp_v, vstack, tmp_v[0])
       else
         vstack.push __send__(method_id, tmp_v, vstack)
@@ -554,6 +942,11 @@ module Racc
 
     # Enter error recovering mode.
     # This method does not call #on_error.
+    #
+    # This method, #yyaccept and #yyerrok must be called from an action, or
+    # from a method defined in the grammar file (or a superclass other than
+    # Racc::Parser).  Racc calls actions that do not mention them without
+    # setting up the catch frame they need.
     def yyerror
       throw :racc_jump, 1
     end
@@ -569,6 +962,46 @@ module Racc
       @racc_error_status = 0
     end
 
+    # If true, the following parses count what the parser does; see
+    # #racc_statistics.  The counting is cheap enough to be left on in
+    # production, unlike @yydebug.
+    attr_accessor :racc_collect_statistics
+
+    # Returns the counts of the last parse as a Hash, or nil unless
+    # #racc_collect_statistics is set:
+    #
+    # :tokens::     the number of tokens read, not counting the end of input
+    # :shifts::     the number of shifts, including the error token
+    # :reductions:: an Array of the number of reductions by each rule, by
+    #               rule number as in the log file of racc -v
+    # :states::     an Array of the number of times each state was entered
+    # :errors::     the number of errors reported to #on_error
+    # :max_depth::  the greatest depth of the state stack
+    #
+    # The C runtime fills it in when the parse ends, also by an exception.
+    attr_reader :racc_statistics
+
+    # The number of events the following parses keep in a ring buffer for
+    # #racc_trace, or nil.  Unlike @yydebug, recording them calls no Ruby
+    # method, so thousands of steps can be kept for a failing input.
+    attr_accessor :racc_trace_size
+
+    # Returns a ParseTrace of the last #racc_trace_size events of the last
+    # parse, or nil unless #racc_trace_size is set.
+    def racc_trace
+      if ring = @racc_trace_ring
+        n = ring.size / 4
+        if @racc_trace_count > n
+          ring = ring.rotate(@racc_trace_count % n * 4)
+        else
+          ring = ring[0, @racc_trace_count * 4]
+        end
+        ParseTrace.new(self.class, ring.pack('l*'), @racc_trace_count)
+      elsif @racc_trace_data
+        ParseTrace.new(self.class, @racc_trace_data, @racc_trace_count)
+      end
+    end
+
     # For debugging output
     def racc_read_token(t, tok, val)
       @racc_debug_out.print 'read    '
@@ -642,4 +1075,139 @@ module Racc
 
   end
 
+  # A parser which is given its input by the caller, token by token, and
+  # keeps its state between the calls.  This allows parsing input which
+  # arrives in chunks without a thread or fiber per input.
+  #
+  # Example:
+  #     parser = MyParser.push_parser
+  #     socket.each_line do |line|
+  #       scan(line) {|tok, val| parser.push tok, val }
+  #     end
+  #     result = parser.finish
+  class PushParser
+
+    def initialize(parser)
+      @parser = parser
+      @finished = true
+      @finished = parser.__send__(:_racc_push_start)
+    end
+
+    # The Racc::Parser given tokens.
+    attr_reader :parser
+
+    # Gives the token TOK and its value VAL to the parser, as
+    # Parser#next_token would return them.  The parser runs until it needs
+    # the next token.  Returns self.
+    def push(tok, val)
+      raise ArgumentError, "token given after the end of parse" if @finished
+      @finished = true
+      @finished = @parser.__send__(:_racc_push, tok, val)
+      self
+    end
+
+    # Ends the input and returns the result of the parse.
+    def finish
+      push false, '$' unless @finished
+      result
+    end
+
+    # True if the parse is finished, by the end of input or by yyaccept.
+    def finished?
+      @finished
+    end
+
+    # The result of the parse, i.e. the value of the start symbol, or nil
+    # if the parse is not finished.
+    def result
+      @finished ? @parser.__send__(:_racc_push_result) : nil
+    end
+
+  end
+
+  # The last events of a parse, recorded when Parser#racc_trace_size is
+  # set.  Each event tells what the parser did and the state it was in
+  # after that.
+  #
+  # Example:
+  #     parser.racc_trace_size = 10_000
+  #     begin
+  #       parser.parse(src)
+  #     rescue Racc::ParseError
+  #       parser.racc_trace.dump($stderr)
+  #       raise
+  #     end
+  class ParseTrace
+
+    READ   = 1   # a token is read
+    SHIFT  = 2   # a token is shifted
+    REDUCE = 3   # a rule is reduced
+    ERROR  = 4   # an error is found
+    POP    = 5   # a state is popped while recovering from an error
+    ACCEPT = 6   # the input is accepted
+
+    KIND_NAMES = %w[? read shift reduce error pop accept].freeze # :nodoc:
+
+    # An event.  +token+ is the terminal id of READ, SHIFT and ERROR, and
+    # +rule+ the rule number of REDUCE; they are -1 otherwise.
+    Event = Struct.new(:kind, :state, :token, :rule)
+
+    include Enumerable
+
+    def initialize(parser_class, data, count)
+      @parser_class = parser_class
+      @data = data
+      @count = count
+    end
+
+    # The events as native int32s, four for each event.
+    attr_reader :data
+
+    # The number of events of the parse, including those not kept.
+    attr_reader :count
+
+    # The number of events kept.
+    def size
+      @data.bytesize / 16
+    end
+
+    # Yields each Event, the oldest first.
+    def each
+      return to_enum(__method__) unless block_given?
+      @data.unpack('l*').each_slice(4) do |kind, state, token, rule|
+        yield Event.new(kind, state, token, rule)
+      end
+      self
+    end
+
+    # Returns EVENT as a line of text, with the names of its symbols.
+    def describe(event)
+      name = KIND_NAMES[event.kind] || '?'
+      case event.kind
+      when READ, SHIFT, ERROR
+        sprintf('%-7s %-16s state %d', name, symbol_name(event.token), event.state)
+      when REDUCE
+        target = @parser_class::Racc_arg[9][event.rule * 3 + 1]
+        sprintf('%-7s %-16s state %d', name,
+                "#{symbol_name(target)} (rule #{event.rule})", event.state)
+      else
+        sprintf('%-7s %-16s state %d', name, '', event.state)
+      end
+    end
+
+    # Writes the events to OUT, one line each.
+    def dump(out = $stderr)
+      out.puts "(#{@count - size} earlier events are not kept)" if @count > size
+      each {|event| out.puts describe(event) }
+      out
+    end
+
+    private
+
+    def symbol_name(id)
+      @parser_class::Racc_token_to_s_table[id] || id.to_s
+    end
+
+  end
+
 end
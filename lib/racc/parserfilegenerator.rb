@@ -13,7 +13,9 @@
 require_relative 'compat'
 require_relative 'sourcetext'
 require_relative 'parser-text'
+require_relative 'cextensiongenerator'
 require 'rbconfig'
+require 'ripper'
 
 module Racc
 
@@ -37,6 +39,14 @@ module Racc
       attr_accessor :superclass
       bool_attr :omit_action_call
       bool_attr :result_var
+      bool_attr :native_stack
+      bool_attr :positional_args
+      bool_attr :token_constants
+      bool_attr :skip_unit_rules
+      bool_attr :share_action_rows
+      bool_attr :packed_tables
+      bool_attr :ruby_parse_loop
+      bool_attr :direct_action_calls
       attr_accessor :header
       attr_accessor :inner
       attr_accessor :footer
@@ -48,6 +58,7 @@ module Racc
       bool_attr :frozen_strings
       bool_attr :make_executable
       attr_accessor :interpreter
+      attr_accessor :c_extension   # feature name of the table extension
 
       def initialize
         # Parameters derived from parser
@@ -56,6 +67,14 @@ module Racc
         self.superclass = 'Racc::Parser'
         self.omit_action_call = true
         self.result_var = true
+        self.native_stack = false
+        self.positional_args = false
+        self.token_constants = false
+        self.skip_unit_rules = false
+        self.share_action_rows = false
+        self.packed_tables = false
+        self.ruby_parse_loop = false
+        self.direct_action_calls = false
         self.header = []
         self.inner  = []
         self.footer = []
@@ -68,6 +87,12 @@ module Racc
         self.frozen_strings = false
         self.make_executable = false
         self.interpreter = nil
+        self.c_extension = nil
+      end
+
+      # Options of States#state_transition_table.
+      def table_options
+        {skip_unit_rules: skip_unit_rules?, share_action_rows: share_action_rows?}
       end
     end
 
@@ -108,6 +133,7 @@ module Racc
       else
         require 'racc/parser.rb'
       end
+      require @params.c_extension if @params.c_extension
       header
       parser_class(@params.classname, @params.superclass) {
         inner
@@ -259,30 +285,39 @@ module Racc
       state_transition_table
     end
 
+    # Writes the parse loop of the ruby_parse_loop option alone, without
+    # the action methods it calls.
+    def put_parse_loop(f)
+      @f = f
+      table = @states.state_transition_table(**@params.table_options)
+      table.use_result_var = @params.result_var?
+      parse_loop table
+    end
+
     private
 
     def state_transition_table
-      table = @states.state_transition_table
+      table = @states.state_transition_table(**@params.table_options)
       table.use_result_var = @params.result_var?
       table.debug_parser = @params.debug_parser?
 
       line "##### State transition tables begin ###"
       line
-      integer_list 'racc_action_table', table.action_table
+      table_list 'racc_action_table', table.action_table
       line
-      integer_list 'racc_action_check', table.action_check
+      table_list 'racc_action_check', table.action_check
       line
-      integer_list 'racc_action_pointer', table.action_pointer
+      table_list 'racc_action_pointer', table.action_pointer
       line
-      integer_list 'racc_action_default', table.action_default
+      table_list 'racc_action_default', table.action_default
       line
-      integer_list 'racc_goto_table', table.goto_table
+      table_list 'racc_goto_table', table.goto_table
       line
-      integer_list 'racc_goto_check', table.goto_check
+      table_list 'racc_goto_check', table.goto_check
       line
-      integer_list 'racc_goto_pointer', table.goto_pointer
+      table_list 'racc_goto_pointer', table.goto_pointer
       line
-      integer_list 'racc_goto_default', table.goto_default
+      table_list 'racc_goto_default', table.goto_default
       line
       i_i_sym_list 'racc_reduce_table', table.reduce_table
       line
@@ -314,14 +349,71 @@ module Racc
           racc_use_result_var ]
       End
       line "Ractor.make_shareable(Racc_arg) if defined?(Ractor)"
+      if @params.packed_tables? or @params.c_extension
+        line "racc_unpacked_arg if Racc_Packed_Tables_Core == 'rb'"
+      end
       line
       string_list 'Racc_token_to_s_table', table.token_to_s_table
       line "Ractor.make_shareable(Racc_token_to_s_table) if defined?(Ractor)"
       line
       line "Racc_debug_parser = #{table.debug_parser}"
       line
+      if @params.token_constants?
+        token_constants table.token_table
+        line "Racc_token_constants = true"
+        line
+      end
+      flags = rule_flags
+      if flags.any? {|f| f != 0 }
+        integer_list 'Racc_rule_flags', flags
+        line "Ractor.make_shareable(Racc_rule_flags) if defined?(Ractor)"
+        line
+      end
+      if @params.native_stack?
+        line "Racc_native_stack = true"
+        line
+      end
+      if @params.positional_args?
+        runtime_check 'Racc_Positional_Args_Core', 'positional_args'
+        line "Racc_positional_args = true"
+        line
+      end
+      if @params.share_action_rows?
+        runtime_check 'Racc_Shared_Action_Rows_Core', 'share_action_rows'
+        line "Racc_shared_action_rows = true"
+        line
+      end
       line '##### State transition tables end #####'
       actions
+      parse_loop table if @params.ruby_parse_loop?
+    end
+
+    # Refuses to load the parser on runtimes which do not define CONST,
+    # since they would run the parser written for OPTION wrongly.
+    def runtime_check(const, option)
+      line "unless Racc::Parser.const_defined?(:#{const})"
+      line "  raise LoadError, \"\#{name}: #{option} needs a newer Racc runtime\""
+      line "end"
+    end
+
+    def table_list(name, table)
+      if @params.c_extension
+        line "#{name} = #{CExtensionGenerator.module_name(@params.c_extension)}::#{name.upcase}"
+      elsif @params.packed_tables?
+        packed_list name, table
+      else
+        integer_list name, table
+      end
+    end
+
+    # Writes TABLE as a String of little endian int32s, nil being
+    # Racc::Parser::Racc_Packed_Nil.  Loading it is much cheaper than
+    # evaluating an Array literal of the same size.
+    def packed_list(name, table)
+      data = table.map {|n| n || Racc::Parser::Racc_Packed_Nil }.pack('l<*')
+      line "#{name} = <<'.,.,'.unpack1('m')"
+      @f.print [data].pack('m')
+      line '.,.,'
     end
 
     def integer_list(name, table)
@@ -344,6 +436,34 @@ module Racc
       line " ]"
     end
 
+    # Code that may leave an action by throw or change the error status.
+    JUMP_RE = /\b(?:yyerror|yyaccept|yyerrok|racc_jump)\b|@racc_error_status/
+
+    def rule_flags
+      direct = direct_action_call?
+      flags = []
+      @grammar.each do |rule|
+        f = 0
+        text = rule.action.source ? rule.action.source.text : ''
+        f |= Parser::Racc_Rule_Uses_Values if /\b_values\b/ =~ text
+        f |= Parser::Racc_Rule_No_Jump if direct and JUMP_RE !~ text
+        flags.push f
+      end
+      flags
+    end
+
+    # Actions can be called without catching :racc_jump only when no
+    # code outside of them may call yyerror and friends on their behalf.
+    # Methods from other files cannot be told from the grammar file, so
+    # the direct_action_calls option has to promise that.
+    def direct_action_call?
+      return false unless @params.direct_action_calls?
+      return false unless @params.superclass.delete_prefix('::') == 'Racc::Parser'
+      (@params.header + @params.inner + @params.footer).none? {|src|
+        JUMP_RE =~ src.text
+      }
+    end
+
     def sym_int_hash(name, h)
       sep = "\n"
       @f.print "#{name} = {"
@@ -354,6 +474,16 @@ module Racc
       line " }"
     end
 
+    def token_constants(h)
+      line "module Tokens"
+      h.to_a.sort_by {|sym, i| i }.each do |sym, i|
+        name = sym.value.to_s
+        next unless sym.value.is_a?(Symbol) and /\A[A-Z]\w*\z/ =~ name
+        line "  #{name} = #{i}"
+      end
+      line "end"
+    end
+
     def string_list(name, list)
       sep = "  "
       line "#{name} = ["
@@ -380,34 +510,42 @@ module Racc
         retval = ''
         default_body = 'val[0]'
       end
+      builtins = []
       @grammar.each do |rule|
         line
         if rule.action.empty? and @params.omit_action_call?
           line "# reduce #{rule.ident} omitted"
+        elsif mid = rule.builtin_action
+          line "# reduce #{rule.ident} is #{mid}"
+          builtins.push mid unless mid == :_reduce_none
         else
           src0 = rule.action.source || SourceText.new(default_body, __FILE__, 0)
+          args = "val, _values#{decl}"
+          if @params.positional_args?
+            src0, args = positional_action(rule, src0, decl)
+          end
           if @params.convert_line?
             src = remove_blank_lines(src0)
             delim = make_delimiter(src.text)
             @f.printf unindent_auto(<<-End),
               module_eval(<<'%s', '%s', %d)
-                def _reduce_%d(val, _values%s)
+                def _reduce_%d(%s)
                   %s%s
                 end
               %s
             End
                       delim, src.filename, src.lineno - 1,
-                        rule.ident, decl,
+                        rule.ident, args,
                         src.text, retval,
                       delim
           else
             src = remove_blank_lines(src0)
             @f.printf unindent_auto(<<-End),
-              def _reduce_%d(val, _values%s)
+              def _reduce_%d(%s)
               %s%s
               end
             End
-                      rule.ident, decl,
+                      rule.ident, args,
                       src.text, retval
           end
         end
@@ -418,7 +556,327 @@ module Racc
           val[0]
         end
       End
+      builtin_actions builtins.uniq, decl
+      line
+    end
+
+    # Defines the built-in actions for runtimes which do not execute them
+    # by themselves.
+    def builtin_actions(mids, decl)
+      args = @params.positional_args? ? '*val, _values' : 'val, _values'
+      mids.each do |mid|
+        line
+        @f.printf unindent_auto(<<-'End'), mid, args, decl, Rule.builtin_action_source(mid)
+          def %s(%s%s)
+            %s
+          end
+        End
+      end
+    end
+
+    # Rewrites the action of RULE for positional_args mode: each RHS value
+    # is passed as its own argument (val_0, val_1, ...) and +val[N]+ in
+    # the action refers to it directly.  Actions which use +val+ in any
+    # other way are left as they are and get +val+ as an Array.
+    def positional_action(rule, src, decl)
+      vals = (0...rule.size).map {|i| "val_#{i}" }
+      args = (vals + ['_values']).join(', ') + decl
+      if text = positional_text(src.text, rule.size)
+        src = SourceText.new(text, src.filename, src.lineno)
+      else
+        args << ", val = [#{vals.join(', ')}]"
+      end
+      return src, args
+    end
+
+    # Replaces the reads +val[N]+ of the local variable +val+ in TEXT by
+    # +val_N+.  Returns nil when TEXT does not parse, or uses +val+
+    # otherwise: assigns it or its elements, shadows it, passes it on.
+    def positional_text(text, n)
+      # Declares val so that Ripper parses it as a local variable.
+      sexp = Ripper.sexp("val = nil\n#{text}") or return nil
+      reads = []
+      walk = lambda {|node|
+        return true unless Array === node
+        case node[0]
+        when :aref
+          if (pos = val_ref(node[1])) and (idx = node[2]) and
+              idx[0] == :args_add_block and idx[1].size == 1 and
+              idx[1][0][0] == :@int and /\A\d+\z/ =~ idx[1][0][1] and
+              idx[1][0][1].to_i < n
+            reads.push [pos, idx[1][0][1].to_i]
+            return true
+          end
+        when :var_ref
+          return false if val_ref(node)
+        when :var_field
+          return false if val_ref(node) and val_ref(node) != [1, 0]
+        when :params
+          return false if node.flatten.each_cons(2).include?([:@ident, 'val'])
+        end
+        node.all?(&walk)
+      }
+      return nil unless walk.call(sexp)
+      lines = text.b.lines
+      out = text.b
+      reads.sort.reverse_each do |(line, col), i|
+        pos = lines[0, line - 2].inject(col) {|sum, l| sum + l.bytesize }
+        ref = out[pos..-1][/\Aval\s*\[\s*#{i}\s*\]/] or return nil
+        out[pos, ref.bytesize] = "val_#{i}"
+      end
+      out.force_encoding(text.encoding)
+    end
+
+    # The position of +val+ if NODE refers to the local variable.
+    def val_ref(node)
+      return nil unless Array === node[1]
+      node[1][0] == :@ident && node[1][1] == 'val' ? node[1][2] : nil
+    end
+
+    # Writes the parse loop of the ruby_parse_loop option, which replaces
+    # the generic loop of the Ruby runtime for #do_parse and
+    # #do_parse_tokens.  The action and goto tables are unrolled into
+    # case statements on Integer literals, and reductions call their
+    # actions directly.  Accepting and error recovery are left to the
+    # generic _racc_evalact.  The branches of large grammars are split
+    # into methods short enough for YJIT to compile.
+    def parse_loop(table)
+      nstates = table.action_pointer.size
+      @loop_methods = []
+      line
+      line '##### Parse loop begin #####'
+      line
+      code 0, <<-End
+        def _racc_do_parse_rb(arg, in_debug)
+          return super unless _racc_parse_loop?
+          _racc_init_sysvars(arg)
+          catch(:racc_end_parse) {
+            _racc_parse_loop(arg, nil, nil)
+          }
+        end
+      End
+      line
+      code 0, <<-End
+        def _racc_do_parse_tokens_rb(arg, types, values, in_debug)
+          return super unless _racc_parse_loop?
+          types = types.unpack('l*') if String === types
+          _racc_init_sysvars(arg)
+          catch(:racc_end_parse) {
+            _racc_parse_loop(arg, types, values)
+          }
+        end
+      End
+      line
+      code 0, <<-End
+        def _racc_parse_loop(arg, types, values)
+          action_pointer = arg[3]
+          token_table = arg[10]
+          states = @racc_state
+          vstack = @racc_vstack
+          pos = 0
+          while true
+            state = states[-1]
+            if @racc_read_next and @racc_t != 0 and action_pointer[state]
+              if types
+                tok = types[pos]
+                @racc_val = tok ? values[pos] : '$'
+                pos += 1
+              else
+                tok, @racc_val = next_token()
+              end
+              if tok
+                @racc_t = (token_table[tok] or
+                           _racc_int_token(tok, token_table, #{table.nt_base}) or
+                           1)   # error token
+              else
+                @racc_t = 0   # EOF
+              end
+              @racc_read_next = false
+            end
+            act =
+      End
+      acts = {}
+      nstates.times do |s|
+        default = table.action_default[s].to_s
+        tacts = table.action_pointer[s] ? lookahead_actions(table, s) : {}
+        acts[s] = tacts.empty? ? [default] : dispatch('@racc_t', tacts, [default])
+      end
+      dispatch('state', acts, nil, ['_racc_loop_action', 'state']).each {|s| code 3, s }
+      code 2, <<-End
+        if act > 0 and act < #{table.shift_n}
+          if @racc_error_status > 0
+            @racc_error_status -= 1 unless @racc_t <= 1   # error token or EOF
+          end
+          vstack.push @racc_val
+          states.push act
+          @racc_read_next = true
+        else
+      End
+      flags = rule_flags
+      gotos = {}
+      reduces = {}
+      table.reduce_table.each_slice(3).with_index do |(len, target, mid), rule|
+        next if rule == 0   # accepted instead
+        goto = gotos[target] ||= parse_loop_goto(table, target - table.nt_base, nstates)
+        body = parse_loop_reduce(len, mid, table.use_result_var)
+        if mid == :_reduce_none or flags[rule] & Parser::Racc_Rule_No_Jump != 0
+          body.concat goto
+        else
+          body = ['code = catch(:racc_jump) {',
+                  *body.map {|s| '  ' + s },
+                  '  false',
+                  '}',
+                  'if code',
+                  '  _racc_parse_loop_jump(code, arg)',
+                  'else',
+                  *goto.map {|s| '  ' + s },
+                  'end']
+        end
+        reduces[-rule] = body
+      end
+      generic = ['# accept or error',
+                 'while act = _racc_evalact(act, arg)',
+                 '  ;',
+                 'end']
+      dispatch('act', reduces, generic,
+               ['_racc_loop_reduce', 'act, states, vstack, arg']).each {|s| code 3, s }
+      line '    end'
+      line '  end'
+      line 'end'
+      @loop_methods.each do |name, params, lines|
+        line
+        line "def #{name}(#{params})"
+        lines.each {|s| code 1, s }
+        line 'end'
+      end
       line
+      line '##### Parse loop end #####'
+    end
+
+    # The actions of state S other than its default action, as
+    # {token => [action]}.
+    def lookahead_actions(table, s)
+      base = table.action_pointer[s]
+      check = @params.share_action_rows? ? base : s
+      acts = {}
+      table.nt_base.times do |t|
+        i = base + t
+        next unless i >= 0 and (act = table.action_table[i]) and
+                    table.action_check[i] == check
+        acts[t] = [act.to_s] unless act == table.action_default[s]
+      end
+      acts
+    end
+
+    # The statements of a reduction by a rule of LEN symbols whose action
+    # is the method MID, up to pushing its value.
+    def parse_loop_reduce(len, mid, use_result)
+      body = []
+      if mid == :_reduce_none
+        # The value of the first symbol stays on the stack.
+        body.push(len == 2 ? 'vstack.pop' : "vstack.pop(#{len - 1})") if len > 1
+        body.push 'vstack.push nil' if len == 0
+      elsif @params.positional_args?
+        vals = (0...len).map {|i| "val_#{i}" }
+        vals.reverse_each {|v| body.push "#{v} = vstack.pop" }
+        args = vals + ['vstack']
+        args.push(vals.first || 'nil') if use_result
+      elsif len == 0
+        args = ['[]', 'vstack']
+        args.push 'nil' if use_result
+      else
+        body.push "val = vstack.pop(#{len})"
+        args = ['val', 'vstack']
+        args.push 'val[0]' if use_result
+      end
+      body.push(len == 1 ? 'states.pop' : "states.pop(#{len})") if len > 0
+      body.push "vstack.push #{mid}(#{args.join(', ')})" if args
+      body
+    end
+
+    # The statements pushing the state which the parser goes to after
+    # reducing to the nonterminal K.  Gotos from many states are a method
+    # of their own, which the reductions to K share.
+    def parse_loop_goto(table, k, nstates)
+      default = table.goto_default[k]
+      gotos = {}
+      if base = table.goto_pointer[k]
+        nstates.times do |s|
+          i = base + s
+          next unless i >= 0 and (st = table.goto_table[i]) and table.goto_check[i] == k
+          gotos[s] = [st.to_s] unless st == default
+        end
+      end
+      return ["states.push #{default}"] if gotos.empty?
+      lines = dispatch('state', gotos, default && [default.to_s], ["_racc_loop_goto_#{k}", 'state'])
+      if gotos.size > PARSE_LOOP_CASE_MAX
+        @loop_methods.push ["_racc_loop_goto_#{k}", 'state', lines]
+        return ["states.push _racc_loop_goto_#{k}(states[-1])"]
+      end
+      lines[-1] += ')'
+      ['state = states[-1]', 'states.push(', *lines.map {|s| '  ' + s }]
+    end
+
+    # The most values a case statement of the parse loop tests; more are
+    # split by comparisons first.  YJIT compiles a case statement into a
+    # chain of guards on the values it has seen, and gives up on a long
+    # one.
+    PARSE_LOOP_CASE_MAX = 16
+
+    # The most lines of a branch of the parse loop before it is moved to a
+    # method of its own.  YJIT does not compile too long a method.
+    PARSE_LOOP_METHOD_MAX = 500
+
+    # Lines of a statement which runs the lines RESULTS[VAR] for the
+    # Integer VAR, or the lines DEFAULT for other values.  Its value is
+    # the one of the lines run.  With SPLIT, [name, parameters], long
+    # branches become methods named after it.
+    def dispatch(var, results, default, split = nil)
+      keys = results.keys.sort
+      return default if keys.empty?
+      if keys.size > PARSE_LOOP_CASE_MAX
+        pivot = keys[keys.size / 2]
+        halves = results.partition {|k, _| k < pivot }.map {|half|
+          lines = dispatch(var, half.to_h, default, split)
+          if split and lines.size > PARSE_LOOP_METHOD_MAX
+            name = "#{split[0]}_#{half[0][0].abs}_#{half[-1][0].abs}"
+            @loop_methods.push [name, split[1], lines]
+            lines = ["#{name}(#{split[1]})"]
+          end
+          lines.map {|s| '  ' + s }
+        }
+        return ["if #{var} < #{pivot}", *halves[0], 'else', *halves[1], 'end']
+      end
+      lines = ["case #{var}"]
+      keys.group_by {|k| results[k] }.each do |result, ks|
+        whens = ks.each_slice(10).map {|row| '     ' + row.join(', ') + ',' }
+        whens[0][0, 5] = 'when '
+        whens[-1].chomp! ','
+        branch lines, whens, ' then', result
+      end
+      branch lines, ['else'], '', default if default
+      lines.push 'end'
+    end
+
+    # Adds a branch of a case statement to LINES: the lines HEAD, and
+    # BODY after them, or on the last of them after SEP.
+    def branch(lines, head, sep, body)
+      if body.size == 1 and not body[0].start_with?('#')
+        lines.concat head[0...-1]
+        lines.push "#{head[-1]}#{sep} #{body[0]}"
+      else
+        lines.concat head
+        lines.concat body.map {|s| '  ' + s }
+      end
+    end
+
+    # Writes the lines of STR, a line or an indented here document, at
+    # DEPTH (in two space steps).
+    def code(depth, str)
+      str = unindent_auto(str) if str.end_with?("\n")
+      str.each_line do |s|
+        line '  ' * depth + s.chomp
+      end
     end
 
     def remove_blank_lines(src)
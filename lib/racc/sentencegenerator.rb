@@ -0,0 +1,218 @@
+require_relative 'grammar'
+require_relative 'exception'
+require_relative 'parser'
+
+module Racc
+
+  # Generates random sentences of a grammar, to be used as the input of
+  # benchmarks and fuzzing.  A sentence is an Array of terminal Syms;
+  # their idents can be passed to the parser as they are:
+  #
+  #   gen = Racc::SentenceGenerator.new(grammar, random: Random.new(1))
+  #   ids = gen.generate(10_000).map(&:ident)
+  #   parser.do_parse_tokens(ids, [])
+  #
+  # Useless rules and rules using the error token are never used.
+  # Sentences may still be rejected by the parser where conflicts are
+  # resolved by +nonassoc+.
+  class SentenceGenerator
+
+    # Returns a parser class of STATES without the actions, which only
+    # accepts or rejects sentences, for testing and benchmarking the
+    # tables.  Its instances take the tokens the pull parser reads:
+    #
+    #   parser = Racc::SentenceGenerator.recognizer(states)
+    #   parser.new(tokens).do_parse
+    #   parser.new.do_parse_tokens(ids, [])
+    def self.recognizer(states)
+      t = states.state_transition_table
+      reduce_table = t.reduce_table.each_slice(3).with_index.flat_map {|(len, target, mid), i|
+        [len, target, i == 0 ? mid : :_reduce_none]
+      }
+      c = Class.new(Parser)
+      c.const_set :Racc_arg, [t.action_table, t.action_check, t.action_default,
+                              t.action_pointer, t.goto_table, t.goto_check,
+                              t.goto_default, t.goto_pointer, t.nt_base,
+                              reduce_table, t.token_value_table,
+                              t.shift_n, t.reduce_n, false]
+      c.const_set :Racc_token_to_s_table, t.token_to_s_table
+      c.const_set :Racc_debug_parser, false
+      c.class_eval do
+        def initialize(tokens = [])
+          @q = tokens.dup
+        end
+
+        def next_token
+          @q.shift
+        end
+
+        def _reduce_none(val, _values)
+          val[0]
+        end
+
+        def on_error(*args)
+          raise ParseError, args.inspect
+        end
+      end
+      c
+    end
+
+    def initialize(grammar, random: Random.new)
+      grammar.init
+      @grammar = grammar
+      @random = random
+      error = grammar.symboltable.error
+      @rules = {}   # nonterminal => rules to expand it with
+      grammar.each_rule do |rule|
+        next if rule.ident == 0 or rule.useless? or rule.symbols.include?(error)
+        (@rules[rule.target] ||= []).push rule
+      end
+      compute_heights
+      unless @height[grammar.start]
+        raise CompileError, 'start symbol does not derive any sentence'
+      end
+      compute_finishing_rules
+      compute_growing_rules
+    end
+
+    # Returns a sentence of at most about LENGTH tokens.  Rules which can
+    # grow the sentence are preferred until it is LENGTH tokens long; a
+    # derivation deeper than MAX_DEPTH is finished as soon as possible.
+    def generate(length, max_depth: length + 100)
+      sentence = []
+      stack = [[@grammar.start, 0]]
+      pending = @min_length[@grammar.start]   # least length of the stack
+      until stack.empty?
+        sym, depth = stack.pop
+        if sym.terminal?
+          sentence.push sym
+          pending -= 1
+          next
+        end
+        pending -= @min_length[sym]
+        room = length - sentence.size - pending
+        rule = (depth < max_depth) ? choose(sym, room) : finish(sym, room)
+        rule.symbols.reverse_each do |s|
+          stack.push [s, depth + 1]
+          pending += @min_length[s]
+        end
+      end
+      sentence
+    end
+
+    private
+
+    def choose(sym, room)
+      fits = @rules[sym].select {|rule| @rule_length[rule] <= room }
+      growing = fits.select {|rule| @growing[rule] }
+      rules = growing.empty? ? fits : growing
+      return finish(sym, room) if rules.empty?
+      rules.sample(random: @random)
+    end
+
+    # Every finishing rule of SYM leads to a lower derivation tree, so
+    # choosing them only ends the derivation.
+    def finish(sym, room)
+      rules = @finishing[sym]
+      fits = rules.select {|rule| @rule_length[rule] <= room }
+      return rules.min_by {|rule| @rule_length[rule] } if fits.empty?
+      fits.sample(random: @random)
+    end
+
+    # @height[sym]: the height of the lowest derivation tree of SYM.
+    # Rules of nonterminals without height are dropped.
+    def compute_heights
+      @height = {}
+      changed = true
+      while changed
+        changed = false
+        @rules.each do |sym, rules|
+          rules.each do |rule|
+            h = rule_height(rule) or next
+            if @height[sym].nil? or h < @height[sym]
+              @height[sym] = h
+              changed = true
+            end
+          end
+        end
+      end
+      @rules.each_value do |rules|
+        rules.select! {|rule| rule_height(rule) }
+      end
+      @rules.delete_if {|sym, rules| rules.empty? }
+    end
+
+    def rule_height(rule)
+      h = 0
+      rule.symbols.each do |sym|
+        next if sym.terminal?
+        sh = @height[sym] or return nil
+        h = sh if sh > h
+      end
+      h + 1
+    end
+
+    # @finishing[sym]: the rules of SYM leading to a lower tree.
+    # @min_length[sym]: the least length of a sentence derived from SYM
+    # with finishing rules only.
+    def compute_finishing_rules
+      @finishing = {}
+      @min_length = Hash.new(1)   # terminals
+      @rule_length = {}
+      @rules.keys.sort_by {|sym| @height[sym] }.each do |sym|
+        @finishing[sym] = @rules[sym].select {|rule| rule_height(rule) <= @height[sym] }
+        @finishing[sym].each do |rule|
+          @rule_length[rule] = rule_length(rule)
+        end
+        @min_length[sym] = @finishing[sym].map {|rule| @rule_length[rule] }.min
+      end
+      @rules.each_value do |rules|
+        rules.each {|rule| @rule_length[rule] ||= rule_length(rule) }
+      end
+    end
+
+    def rule_length(rule)
+      rule.symbols.sum {|sym| @min_length[sym] }
+    end
+
+    # @growing[rule]: RULE uses a nonterminal which derives sentences of
+    # any length, i.e. reaches a recursive nonterminal.
+    def compute_growing_rules
+      edges = {}
+      @rules.each do |sym, rules|
+        edges[sym] = rules.flat_map {|rule| rule.symbols.select(&:nonterminal?) }.uniq
+      end
+      recursive = edges.keys.select {|sym| reachable(edges, sym).include?(sym) }
+      reverse = Hash.new {|h, k| h[k] = [] }
+      edges.each do |sym, dests|
+        dests.each {|dest| reverse[dest].push sym }
+      end
+      unbounded = {}
+      queue = recursive.dup
+      while sym = queue.shift
+        next if unbounded[sym]
+        unbounded[sym] = true
+        queue.concat reverse[sym]
+      end
+      @growing = {}
+      @rules.each_value do |rules|
+        rules.each do |rule|
+          @growing[rule] = rule.symbols.any? {|sym| unbounded[sym] }
+        end
+      end
+    end
+
+    def reachable(edges, sym)
+      seen = {}
+      stack = edges[sym].dup
+      while s = stack.pop
+        next if seen[s]
+        seen[s] = true
+        stack.concat edges[s]
+      end
+      seen
+    end
+
+  end
+
+end
@@ -10,7 +10,6 @@
 #
 #++
 
-require_relative 'iset'
 require_relative 'statetransitiontable'
 require_relative 'exception'
 require 'forwardable'
@@ -93,8 +92,28 @@ module Racc
       @n_rrconflicts ||= inject(0) {|sum, st| sum + st.n_rrconflicts }
     end
 
-    def state_transition_table
-      @state_transition_table ||= StateTransitionTable.generate(self.dfa)
+    def state_transition_table(**options)
+      @state_transition_tables ||= {}
+      @state_transition_tables[options] ||=
+          begin
+            table = StateTransitionTable.generate(self.dfa, **options)
+            # Closures are not needed anymore; the verbose log file
+            # computes them again if it shows them.
+            each_state {|state| state.release_closure }
+            table
+          end
+    end
+
+    # Sets the result of #state_transition_table for OPTIONS and the
+    # numbers of conflicts to those saved by TableCache, instead of
+    # computing the states.  Nothing else is available afterwards.
+    def restore(options, table, n_srconflicts, n_rrconflicts)
+      @grammar.init
+      @state_transition_tables = {options => table}
+      @n_srconflicts = n_srconflicts
+      @n_rrconflicts = n_rrconflicts
+      @nfa_computed = @dfa_computed = true
+      self
     end
 
     #
@@ -114,8 +133,15 @@ module Racc
 
     def compute_nfa
       @grammar.init
+      # Item sets are handled as sorted Arrays of LocationPointer#ident
+      # while the states are generated.  @items maps them back.
+      @items = []
+      @grammar.each_rule do |rule|
+        rule.ptrs.each {|ptr| @items[ptr.ident] = ptr }
+      end
+      @expansions = {}
       # add state 0
-      core_to_state  [ @grammar[0].ptrs[0] ]
+      core_to_state  [ @grammar[0].ptrs[0].ident ]
       # generate LALR states
       cur = 0
       @gotos = []
@@ -124,6 +150,7 @@ module Racc
         cur += 1
       end
       @actions.init
+      @items = @expansions = @statecache = nil
     end
 
     def generate_states(state)
@@ -132,13 +159,15 @@ module Racc
       table = {}
       state.closure.each do |ptr|
         if sym = ptr.dereference
-          addsym table, sym, ptr.next
+          # The idents of the pointers in a rule are consecutive,
+          # so ptr.next.ident is ptr.ident + 1.
+          (table[sym] ||= []).push ptr.ident + 1
         end
       end
       table.each do |sym, core|
-        puts "dstate: sym=#{sym} ncore=#{core}" if @d_state
+        puts "dstate: sym=#{sym} ncore=[#{core.map {|i| @items[i] }.join(' ')}]" if @d_state
 
-        dest = core_to_state(core.to_a)
+        dest = core_to_state(core)
         state.goto_table[sym] = dest
         id = sym.nonterminal?() ? @gotos.size : nil
         g = Goto.new(id, sym, state, dest)
@@ -155,23 +184,18 @@ module Racc
       end
     end
 
-    def addsym(table, sym, ptr)
-      unless s = table[sym]
-        table[sym] = s = ISet.new
-      end
-      s.add ptr
-    end
-
     def core_to_state(core)
       #
-      # convert CORE to a State object.
+      # convert CORE, a sorted Array of item idents, to a State object.
       # If matching state does not exist, create it and add to the table.
       #
 
-      k = fingerprint(core)
+      k = core.pack('L*')
       unless dest = @statecache[k]
         # not registered yet
-        dest = State.new(@states.size, core)
+        dest = State.new(@states.size,
+                         core.map {|i| @items[i] },
+                         closure_items(core).map {|i| @items[i] })
         @states.push dest
 
         @statecache[k] = dest
@@ -187,8 +211,22 @@ module Racc
       dest
     end
 
-    def fingerprint(arr)
-      arr.map {|i| i.ident }.pack('L*')
+    # Returns the closure of CORE as a sorted Array of item idents.
+    # The items added for the nonterminals after the dots depend on
+    # these nonterminals only, so they are cached by their set, which
+    # many states share.
+    def closure_items(core)
+      syms = []
+      core.each do |i|
+        sym = @items[i].dereference
+        syms.push sym if sym and sym.nonterminal?
+      end
+      return core if syms.empty?
+      syms.uniq!
+      syms.sort_by!(&:ident)
+      expansion = (@expansions[syms.map(&:ident)] ||=
+                     syms.flat_map {|t| t.expand.map(&:ident) }.uniq.sort)
+      (core | expansion).sort
     end
 
     #
@@ -350,6 +388,14 @@ module Racc
     end
 
     def digraph(map, relation)
+      if defined?(Racc::Cparse.digraph)
+        Racc::Cparse.digraph map, relation
+      else
+        digraph_rb map, relation
+      end
+    end
+
+    def digraph_rb(map, relation)
       n = relation.size
       index    = Array.new(n, nil)
       vertices = []
@@ -362,30 +408,49 @@ module Racc
       end
     end
 
+    # Walks the relation depth first from I.  This uses its own stack of
+    # [vertex, height, next edge] frames instead of recursion, so a long
+    # chain of relations cannot overflow the Ruby stack.
     def traverse(i, index, vertices, map, relation)
       vertices.push i
-      index[i] = height = vertices.size
-
-      if rp = relation[i]
-        rp.each do |proci|
-          unless index[proci]
-            traverse proci, index, vertices, map, relation
-          end
-          if index[i] > index[proci]
-            # circulative recursion !!!
-            index[i] = index[proci]
+      index[i] = vertices.size
+      stack = [[i, vertices.size, 0]]
+
+      until stack.empty?
+        frame = stack.last
+        x = frame[0]
+        rp = relation[x]
+        if rp and frame[2] < rp.size
+          proci = rp[frame[2]]
+          frame[2] += 1
+          if index[proci]
+            if index[x] > index[proci]
+              # circulative recursion !!!
+              index[x] = index[proci]
+            end
+            map[x] |= map[proci]
+          else
+            vertices.push proci
+            index[proci] = vertices.size
+            stack.push [proci, vertices.size, 0]
           end
-          map[i] |= map[proci]
+          next
         end
-      end
 
-      if index[i] == height
-        while true
-          proci = vertices.pop
-          index[proci] = @infinity
-          break if i == proci
+        stack.pop
+        if index[x] == frame[1]
+          while true
+            proci = vertices.pop
+            index[proci] = @infinity
+            break if x == proci
 
-          map[proci] |= map[i]
+            map[proci] |= map[x]
+          end
+        end
+        if parent = stack.last
+          y = parent[0]
+          index[y] = index[x] if index[y] > index[x]
+          map[y] |= map[x]
         end
       end
     end
@@ -604,13 +669,58 @@ module Racc
       end
     end
 
+    #
+    # Unit Rule Elimination
+    #
+
+    public
+
+    # Returns a Hash which maps a state to the gotos ({nonterminal => state})
+    # that can skip unit reductions.  When the goto destination of a state
+    # does nothing but reduce by a unit rule without action (A: B), the
+    # parser pops straight back to the same state and takes its goto on A,
+    # so the goto on B may as well go to that state directly.
+    def unit_rule_shortcuts
+      dfa
+      result = {}
+      @states.each do |state|
+        state.goto_table.each do |sym, dest|
+          to = skip_unit_reductions(state, dest)
+          (result[state] ||= {})[sym] = to unless to == dest
+        end
+      end
+      result
+    end
+
+    private
+
+    def skip_unit_reductions(state, dest)
+      seen = {}
+      while (rule = unit_reduction(dest)) and not seen[dest]
+        seen[dest] = true
+        to = state.goto_table[rule.target] or break
+        dest = to
+      end
+      dest
+    end
+
+    # The unit rule which DEST always reduces by, regardless of lookahead.
+    def unit_reduction(dest)
+      return nil unless dest.action.empty?
+      return nil unless dest.defact.kind_of?(Reduce)
+      rule = dest.defact.rule
+      return nil unless rule.size == 1 and rule.symbols[0].nonterminal?
+      return nil unless rule.action.empty?
+      rule
+    end
+
   end   # class StateTable
 
 
   # A LALR state.
   class State
 
-    def initialize(ident, core)
+    def initialize(ident, core, closure = nil)
       @ident = ident
       @core = core
       @goto_table = {}
@@ -622,7 +732,7 @@ module Racc
       @rrconf = nil
       @srconf = nil
 
-      @closure = make_closure(@core)
+      @closure = closure
     end
 
     attr_reader :ident
@@ -630,7 +740,15 @@ module Racc
     alias hash ident
 
     attr_reader :core
-    attr_reader :closure
+
+    # The items of the state: the core and the rules they expand to.
+    def closure
+      @closure ||= make_closure(@core)
+    end
+
+    def release_closure
+      @closure = nil
+    end
 
     attr_reader :goto_table
     attr_reader :gotos
@@ -658,14 +776,13 @@ module Racc
     alias eql? ==
 
     def make_closure(core)
-      set = ISet.new
+      set = core.dup
       core.each do |ptr|
-        set.add ptr
         if t = ptr.dereference and t.nonterminal?
-          set.update_a t.expand
+          set.concat t.expand
         end
       end
-      set.to_a
+      set.uniq(&:ident).sort_by(&:ident)
     end
 
     def check_la(la_rules)
@@ -706,6 +823,13 @@ module Racc
       @conflict
     end
 
+    # True if this state always reduces by the same rule.  Such a state
+    # has no entry in the action table, so the parser reduces without
+    # reading (or waiting for) the lookahead token.
+    def default_reduction?
+      @action.empty? and @defact.kind_of?(Reduce)
+    end
+
     def rruleid(rule)
       if i = @la_rules.index(rule.ident)
         @la_rules_i + i
@@ -31,8 +31,14 @@ module Racc
                                     :use_result_var,
                                     :debug_parser)
   class StateTransitionTable   # reopen
-    def StateTransitionTable.generate(states)
-      StateTransitionTableGenerator.new(states).generate
+    # Members computed from the states.  The others depend on the
+    # grammar only.
+    STATE_MEMBERS = [:action_table, :action_check, :action_default,
+                     :action_pointer, :goto_table, :goto_check,
+                     :goto_default, :goto_pointer, :reduce_n, :shift_n]
+
+    def StateTransitionTable.generate(states, **options)
+      StateTransitionTableGenerator.new(states, **options).generate
     end
 
     def initialize(states)
@@ -62,22 +68,39 @@ module Racc
 
   class StateTransitionTableGenerator
 
-    def initialize(states)
+    def initialize(states, skip_unit_rules: false, share_action_rows: false)
       @states = states
       @grammar = states.grammar
+      @shortcuts = skip_unit_rules ? states.unit_rule_shortcuts : {}
+      @share_action_rows = share_action_rows
     end
 
     def generate
       t = StateTransitionTable.new(@states)
       gen_action_tables t, @states
       gen_goto_tables t, @grammar
-      t.token_table = token_table(@grammar)
-      t.reduce_table = reduce_table(@grammar)
       t.reduce_n = @states.reduce_n
       t.shift_n = @states.shift_n
+      gen_grammar_tables t
+      t
+    end
+
+    # Builds a table from VALUES of StateTransitionTable::STATE_MEMBERS
+    # saved for the same grammar, without computing the states.
+    def restore(values)
+      t = StateTransitionTable.new(@states)
+      StateTransitionTable::STATE_MEMBERS.zip(values) do |member, value|
+        t[member] = value
+      end
+      gen_grammar_tables t
+      t
+    end
+
+    def gen_grammar_tables(t)
+      t.token_table = token_table(@grammar)
+      t.reduce_table = reduce_table(@grammar)
       t.nt_base = @grammar.nonterminal_base
       t.token_to_s_table = @grammar.symbols.map {|sym| sym.to_s }
-      t
     end
 
     def reduce_table(grammar)
@@ -88,7 +111,7 @@ module Racc
         t.push rule.target.ident
         t.push(if rule.action.empty?   # and @params.omit_action_call?
                then :_reduce_none
-               else "_reduce_#{idx}".intern
+               else rule.builtin_action || "_reduce_#{idx}".intern
                end)
       end
       t
@@ -109,9 +132,12 @@ module Racc
       t.action_pointer = yypact   = []
       e1 = []
       e2 = []
+      rows = {}    # vector => index of its state in yypact
+      dups = {}    # index in yypact => index of the state sharing its row
       states.each do |state|
         yydefact.push act2actid(state.defact)
         if state.action.empty?
+          # Also done for a default reduction: no lookahead is needed.
           yypact.push nil
           next
         end
@@ -119,9 +145,18 @@ module Racc
         state.action.each do |tok, act|
           vector[tok.ident] = act2actid(act)
         end
+        if @share_action_rows and (i = rows[vector])
+          dups[yypact.size] = i
+          yypact.push nil
+          next
+        end
+        rows[vector] = yypact.size
         addent e1, vector, state.ident, yypact
       end
-      set_table e1, e2, yytable, yycheck, yypact
+      set_table e1, e2, yytable, yycheck, yypact, @share_action_rows
+      dups.each do |dup, i|
+        yypact[dup] = yypact[i]
+      end
     end
 
     def gen_goto_tables(t, grammar)
@@ -131,22 +166,27 @@ module Racc
       t.goto_default = yydefgoto = []
       e1 = []
       e2 = []
+      # collect the gotos of all states at once: {nonterminal => [[from, to]]}
+      columns = {}
+      @states.each do |state|
+        state.goto_table.each_key do |sym|
+          next if sym.terminal?
+          (columns[sym] ||= []).push [state.ident, goto_state(state, sym).ident]
+        end
+      end
+
       grammar.each_nonterminal do |tok|
         tmp = []
 
         # decide default
-        freq = Array.new(@states.size, 0)
-        @states.each do |state|
-          st = state.goto_table[tok]
-          if st
-            st = st.ident
-            freq[st] += 1
-          end
-          tmp[state.ident] = st
+        freq = Hash.new(0)
+        (columns[tok] || []).each do |from, to|
+          freq[to] += 1
+          tmp[from] = to
         end
-        max = freq.max
+        max = freq.each_value.max || 0
         if max > 1
-          default = freq.index(max)
+          default = freq.select {|st, n| n == max }.keys.min
           tmp.map! {|i| default == i ? nil : i }
         else
           default = nil
@@ -166,6 +206,11 @@ module Racc
       set_table e1, e2, yytable2, yycheck2, yypgoto
     end
 
+    def goto_state(state, tok)
+      shortcut = @shortcuts[state]
+      (shortcut and shortcut[tok]) || state.goto_table[tok]
+    end
+
     def addent(all, arr, chkval, ptr)
       max = arr.size
       min = nil
@@ -176,7 +221,7 @@ module Racc
       end
       ptr.push(-7777)    # mark
       arr = arr[min...max]
-      all.push [arr, chkval, mkmapexp(arr), min, ptr.size - 1]
+      all.push [arr, chkval, min, ptr.size - 1]
     end
 
     n = 2 ** 16
@@ -219,18 +264,39 @@ module Racc
       Regexp.compile(map, Regexp::NOENCODING)
     end
 
-    def set_table(entries, dummy, tbl, chk, ptr)
-      upper = 0
-      map = '-' * 10240
-
+    # Packs the rows of ENTRIES into TBL and CHK, and sets their offsets
+    # in PTR.  If CHECK_BASE is true, no two rows get the same offset and
+    # CHK holds the offset of each row instead of its check value, so
+    # that several states can share one row.
+    def set_table(entries, dummy, tbl, chk, ptr, check_base = false)
       # sort long to short
       entries.sort_by!.with_index {|a,i| [-a[0].size, i] }
 
-      entries.each do |arr, chkval, expr, min, ptri|
+      if defined?(Racc::Cparse.pack_table)
+        Racc::Cparse.pack_table entries, tbl, chk, ptr, check_base
+      else
+        set_table_rb entries, tbl, chk, ptr, check_base
+      end
+    end
+
+    # Places each row at the first position where its entries fit,
+    # searching a map of the taken slots with a Regexp made from the row.
+    def set_table_rb(entries, tbl, chk, ptr, check_base = false)
+      upper = 0
+      map = '-' * 10240
+      bases = {}
+
+      entries.each do |arr, chkval, min, ptri|
         if upper + arr.size > map.size
           map << '-' * (arr.size + 1024)
         end
+        expr = mkmapexp(arr)
         idx = map.index(expr)
+        if check_base
+          idx = map.index(expr, idx + 1) while bases[idx - min]
+          bases[idx - min] = true
+          chkval = idx - min
+        end
         ptr[ptri] = idx - min
         arr.each_with_index do |item, i|
           if item
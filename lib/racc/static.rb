@@ -2,4 +2,7 @@ require_relative '../racc'
 require_relative 'parser'
 require_relative 'grammarfileparser'
 require_relative 'parserfilegenerator'
+require_relative 'cextensiongenerator'
 require_relative 'logfilegenerator'
+require_relative 'tablecache'
+require_relative 'sentencegenerator'
@@ -0,0 +1,72 @@
+require_relative 'state'
+require 'digest'
+require 'fileutils'
+
+module Racc
+
+  # Keeps the state transition tables of grammars in a directory, in
+  # files named by a digest of what the tables are computed from: the
+  # rules, the symbols and their precedence, and the table options.
+  # Changing the actions or the user code keeps the tables usable.
+  class TableCache
+
+    def initialize(dir)
+      @dir = dir
+    end
+
+    # Returns States of GRAMMAR restored from the cache, or nil.  Only the
+    # table for OPTIONS and the numbers of conflicts are available from
+    # them; the states themselves are not computed.
+    def fetch(grammar, options)
+      path = path_for(grammar, options)
+      return nil unless File.file?(path)
+      begin
+        data = Marshal.load(File.binread(path))
+      rescue ArgumentError, TypeError
+        return nil
+      end
+      states = States.new(grammar)
+      table = StateTransitionTableGenerator.new(states).restore(data[:table])
+      states.restore(options, table, data[:n_srconflicts], data[:n_rrconflicts])
+    end
+
+    # Saves the table of STATES for OPTIONS.
+    def store(states, options)
+      table = states.state_transition_table(**options)
+      data = {
+        table: StateTransitionTable::STATE_MEMBERS.map {|m| table[m] },
+        n_srconflicts: states.n_srconflicts,
+        n_rrconflicts: states.n_rrconflicts
+      }
+      path = path_for(states.grammar, options)
+      FileUtils.mkdir_p @dir
+      tmp = "#{path}.#{$$}"
+      File.binwrite tmp, Marshal.dump(data)
+      File.rename tmp, path
+    end
+
+    private
+
+    def path_for(grammar, options)
+      File.join(@dir, "#{digest(grammar, options)}.racctab")
+    end
+
+    def digest(grammar, options)
+      grammar.init
+      key = [
+        Racc::VERSION,
+        options.sort,
+        grammar.start.ident,
+        grammar.symboltable.map {|s| [s.value, s.precedence, s.assoc] },
+        grammar.each_rule.map {|rule|
+          [rule.target.ident, rule.symbols.map(&:ident),
+           rule.precedence && rule.precedence.ident,
+           rule.action.empty?, rule.builtin_action]
+        }
+      ]
+      Digest::SHA256.hexdigest(Marshal.dump(key))
+    end
+
+  end
+
+end
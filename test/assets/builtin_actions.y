@@ -0,0 +1,84 @@
+#
+# actions run as built-in reductions: only those of the rules generated
+# for `*', `+', `?' and groups, never hand-written ones
+#
+
+class BuiltinActions
+
+  prechigh
+    left '+'
+  preclow
+
+rule
+
+  target: stmts
+        ;
+
+  stmts : stmt*
+        ;
+
+  stmt  : expr? ';'      { result = val[0] }
+        | '(' args ')'   { result = val[1] }
+        | '[' NUM+ ']'   { result = val }
+        | '{' (NUM ':' NUM) '}' { result = val[1] }
+        | 'nil' ';'      { result = nil }
+        | '!' ';'        { result = val[3] }
+        ;
+
+  args  : NUM            { result = List[val[0]] }
+        | args ',' NUM   { result = val[0].push(val[2]) }
+        ;
+
+  expr  : NUM
+        | expr '+' expr  { result = val[0] + val[2] }
+        ;
+
+end
+
+---- inner
+
+  # A list whose push must be called.
+  class List < Array
+    attr_reader :pushes
+
+    def push(*args)
+      @pushes = (@pushes || 0) + 1
+      super
+    end
+  end
+
+  def parse(str)
+    @q = str.scan(/\d+|nil|\S/).map {|s|
+      /\d/ =~ s ? [:NUM, s.to_i] : [s, s]
+    }
+    @q.push [false, '$']
+    do_parse
+  end
+
+  def next_token
+    @q.shift
+  end
+
+---- footer
+
+{
+  ''                    => [],
+  '1;'                  => [1],
+  ';'                   => [nil],
+  '1 + 2; 3;'           => [3, 3],
+  '(1, 2, 3)'           => [[1, 2, 3]],
+  '(4)'                 => [[4]],
+  '[1 2]'               => [['[', [1, 2], ']']],
+  'nil; !;'             => [nil, nil],
+  '{1 : 2}'             => [[1, ':', 2]],
+}.each do |src, expected|
+  result = BuiltinActions.new.parse(src)
+  raise "#{src}: wrong result: #{result.inspect}" unless result == expected
+end
+
+result = BuiltinActions.new.parse('(1, 2, 3)')
+raise 'List#push not called' unless result[0].pushes == 2
+
+# The hand-written actions are called even when they read like built-in ones.
+builtins = BuiltinActions::Racc_arg[9].each_slice(3).map {|_, _, mid| mid }.grep(/\A_racc_builtin_/)
+raise "wrong built-in actions: #{builtins.inspect}" unless builtins.sort == [:_racc_builtin_array] + [:_racc_builtin_prepend] * 4
@@ -0,0 +1,78 @@
+#
+# reductions that do not wait for the lookahead token
+#
+
+class DefaultReduction
+
+rule
+
+  target: stmts
+        ;
+
+  stmts : /* none */
+        | stmts stmt
+        ;
+
+  stmt  : ID '=' NUM ';'  { @done.push val[0] }
+        ;
+
+end
+
+---- inner
+
+  def initialize(str)
+    @str = str
+    @done = []
+  end
+
+  attr_reader :done
+
+  # Every statement before the token yielded must be reduced already.
+  def each_token
+    n = 0
+    @str.scan(/\d+|\w+|\S/) do |s|
+      case s
+      when /\A\d/
+        yield [:NUM, s.to_i]
+      when /\A\w/
+        raise "#{s}: statement not reduced yet" unless @done.size == n
+        n += 1
+        yield [:ID, s]
+      else
+        yield [s, s]
+      end
+    end
+    raise "$: statement not reduced yet" unless @done.size == n
+    yield [false, '$']
+  end
+
+  def parse
+    @q = to_enum(:each_token)
+    do_parse
+  end
+
+  def next_token
+    @q.next
+  end
+
+---- footer
+
+src = 'a = 1; b = 2; c = 3;'
+
+parser = DefaultReduction.new(src)
+parser.parse
+raise "wrong result: #{parser.done.inspect}" unless parser.done == %w(a b c)
+
+parser = DefaultReduction.new(src)
+parser.yyparse parser, :each_token
+raise "wrong result: #{parser.done.inspect}" unless parser.done == %w(a b c)
+
+push = DefaultReduction.new(src).push_parser
+push.parser.each_token do |tok, val|
+  push.push tok, val if tok
+  if tok == ';' and push.parser.done.empty?
+    raise 'statement not reduced after ;'
+  end
+end
+push.finish
+raise "wrong result: #{push.parser.done.inspect}" unless push.parser.done == %w(a b c)
@@ -0,0 +1,95 @@
+#
+# options native_stack test
+#
+
+class NativeStack
+
+  options native_stack
+
+rule
+
+  target: stmts { result = [val[0], @depth] }
+        ;
+
+  stmts : /* none */ { result = [] }
+        | stmts stmt { result = val[0].push(val[1]) }
+        ;
+
+  stmt  : ID { @depth = [@depth, _values.size].max } '=' exp ';'
+            {
+              raise 'wrong _values' unless _values.size == 1 and _values[0].is_a?(Array)
+              result = [val[0], val[3]]
+            }
+        | error ';'
+            {
+              result = :error
+            }
+        ;
+
+  exp   : NUM
+        | '(' exp ')' { result = val[1] }
+        | '[' NUM+ { verify_compaction } ']' { result = val[1] }
+        ;
+
+end
+
+---- inner
+
+  def parse(src)
+    @depth = 0
+    @q = src
+    do_parse
+  end
+
+  def next_token
+    GC.start if @q.size % 50 == 0
+    compact if @q.size % 300 == 0
+    @q.shift
+  end
+
+  # The values on the native stack are moved by compaction.
+  def compact
+    GC.compact if GC.respond_to?(:compact)
+  rescue NotImplementedError
+  end
+
+  # Moves every object, including the Array of the built-in action for
+  # NUM+ on the native stack, and checks the references to them.
+  def verify_compaction
+    if GC.respond_to?(:verify_compaction_references)
+      GC.verify_compaction_references(expand_heap: true, toward: :empty)
+      GC.verify_internal_consistency
+    end
+  rescue NotImplementedError
+  end
+
+  def on_error(t, val, values)
+    raise 'wrong value stack' unless values.is_a?(Array)
+  end
+
+---- footer
+
+src = []
+200.times do |i|
+  src.push [:ID, "v#{i}"], ['=', '='], ['(', '('], ['(', '(']
+  src.push [:NUM, i], [')', ')'], [')', ')'], [';', ';']
+end
+src.push [:ID, 'y'], ['=', '='], ['[', '[']
+src.push [:NUM, 1], [:NUM, 2], [:NUM, 3], [']', ']'], [';', ';']
+src.push [:ID, 'x'], [:NUM, 0], [';', ';']
+src.push [false, '$']
+
+stmts, depth = NativeStack.new.parse(src)
+raise "wrong result: #{stmts.size}" unless stmts.size == 202
+raise "wrong result: #{stmts[199].inspect}" unless stmts[199] == ["v199", 199]
+raise "wrong result: #{stmts[200].inspect}" unless stmts[200] == ["y", [1, 2, 3]]
+raise "wrong result: #{stmts[201].inspect}" unless stmts[201] == :error
+raise "wrong depth: #{depth}" unless depth == 2
+
+# The memory of the native stacks is counted.
+if defined?(Racc::CparseParams)
+  require 'objspace'
+  params = ObjectSpace.each_object(Racc::CparseParams).to_a
+  size = params.map {|v| ObjectSpace.memsize_of(v) }.max
+  raise "wrong memsize: #{size}" unless size > 64 * 8 * 2
+end
@@ -0,0 +1,79 @@
+#
+# state transition tables written as packed binary strings
+#
+
+class PackedTables
+
+  options packed_tables
+
+  prechigh
+    left '*' '/'
+    left '+' '-'
+  preclow
+
+rule
+
+  target: stmts
+        ;
+
+  stmts : /* none */     { result = [] }
+        | stmts stmt     { result = val[0].push(val[1]) }
+        ;
+
+  stmt  : expr ';'
+        | error ';'      { result = :error }
+        ;
+
+  expr  : NUM
+        | '(' expr ')'   { result = val[1] }
+        | expr '+' expr  { result = val[0] + val[2] }
+        | expr '-' expr  { result = val[0] - val[2] }
+        | expr '*' expr  { result = val[0] * val[2] }
+        | expr '/' expr  { result = val[0] / val[2] }
+        ;
+
+end
+
+---- inner
+
+  def parse(str, ruby_core = false)
+    @q = str.scan(/\d+|\S/).map {|s|
+      /\d/ =~ s ? [:NUM, s.to_i] : [s, s]
+    }
+    @q.push [false, '$']
+    if ruby_core
+      _racc_setup
+      _racc_do_parse_rb(self.class.racc_unpacked_arg, false)
+    else
+      do_parse
+    end
+  end
+
+  def next_token
+    @q.shift
+  end
+
+  def on_error(*)
+  end
+
+---- footer
+
+arg = PackedTables::Racc_arg
+raise 'tables are not packed' unless arg[0...8].all? {|t| String === t }
+unpacked = PackedTables.racc_unpacked_arg
+raise 'nil is not unpacked' unless unpacked[0...8].any? {|t| t.include?(nil) }
+unless unpacked[0...8].map(&:size) == arg[0...8].map {|t| t.bytesize / 4 }
+  raise 'wrong table size'
+end
+
+{
+  '1 + 2 * 3;'          => [7],
+  '(1 + 2) * 3; 8 / 2;' => [9, 4],
+  '1 1; 2; 3;'          => [:error, 2, 3],
+  '(1 2); 4;'           => [:error, 4],
+}.each do |src, expected|
+  [false, true].each do |ruby_core|
+    result = PackedTables.new.parse(src, ruby_core)
+    raise "#{src}: wrong result: #{result.inspect}" unless result == expected
+  end
+end
@@ -0,0 +1,54 @@
+#
+# actions of the positional_args option which use val in other ways
+# than reading val[N]
+#
+
+class PositionalActions
+
+  options positional_args
+
+rule
+
+  stmts : /* none */ { result = [] }
+        | stmts stmt ';' { result = val[0].push(val[1]) }
+        ;
+
+  stmt  : 'a' NUM { @val = [:ivar]; result = @val[0] }
+        | 'b' NUM { result = Node.new([:call, :call]).val[1] }
+        | 'c' NUM {
+            # val[0]
+            result = "val[1] #{val[1]}"
+          }
+        | 'd' NUM { val[1] += 1; result = val }
+        | 'e' NUM { val[0] = :assigned; result = val[0] }
+        | 'f' NUM { $val = [:gvar, :gvar]; result = $val[1] }
+        | 'g' NUM { [[:shadowed]].each {|val| result = val[0] } }
+        | 'h' NUM { result = val[1] * 2 }
+        ;
+
+end
+
+---- inner
+
+  Node = Struct.new(:val)
+
+  def parse(str)
+    @q = str.scan(/\d+|\S/).map {|s| /\d/ =~ s ? [:NUM, s.to_i] : [s, s] }
+    do_parse
+  end
+
+  def next_token
+    @q.shift || [false, '$']
+  end
+
+---- footer
+
+result = PositionalActions.new.parse('a 1; b 2; c 3; d 4; e 5; f 6; g 7; h 8;')
+expected = [:ivar, :call, 'val[1] 3', ['d', 5], :assigned, :gvar, :shadowed, 16]
+raise "wrong result: #{result.inspect}" unless result == expected
+
+# Only the actions which read nothing but val[N] do without the Array.
+arrays = PositionalActions.instance_methods(false).grep(/\A_reduce_\d+\z/).count {|mid|
+  PositionalActions.instance_method(mid).parameters.include?([:opt, :val])
+}
+raise "wrong number of actions with val: #{arrays}" unless arrays == 3
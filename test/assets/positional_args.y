@@ -0,0 +1,63 @@
+#
+# options positional_args test
+#
+
+class PositionalArgs
+
+  options positional_args
+
+  prechigh
+    left '*'
+    left '+'
+  preclow
+
+rule
+
+  target: exps { result = [val[0], @stack_depth] }
+        ;
+
+  exps  : /* none */ { result = [] }
+        | exps exp ';' { result = val[0].push(val[1]) }
+        | exps error ';' { val[0].push(:error) }
+        ;
+
+  exp   : exp '+' exp { result = val[0] + val[2] }
+        | exp '*' exp { result = val[0] * val[2] }
+        | '(' exp ')' { @stack_depth = [@stack_depth, _values.size].max; result = val[1] }
+        | '[' list ']' { result = val }
+        | NUM
+        ;
+
+  list  : /* none */ { result = val.size }
+        | NUM { result = val[0] }
+        ;
+
+end
+
+---- inner
+
+  def parse(src)
+    @stack_depth = 0
+    @q = src
+    do_parse
+  end
+
+  def next_token
+    @q.shift
+  end
+
+  def on_error(t, val, values)
+  end
+
+---- footer
+
+src = [
+  [:NUM, 1], ['+', '+'], [:NUM, 2], ['*', '*'], ['(', '('], [:NUM, 3], [')', ')'], [';', ';'],
+  ['[', '['], [']', ']'], [';', ';'],
+  ['[', '['], [:NUM, 7], [']', ']'], [';', ';'],
+  [:NUM, 1], [:NUM, 2], [';', ';'],
+  [false, '$']
+]
+exps, depth = PositionalArgs.new.parse(src)
+raise "wrong result: #{exps.inspect}" unless exps == [7, ['[', 0, ']'], ['[', 7, ']'], :error]
+raise "wrong depth: #{depth}" unless depth == 5
@@ -0,0 +1,70 @@
+#
+# Racc::PushParser test
+#
+
+class PushCalc
+
+  prechigh
+    left '*'
+    left '+'
+  preclow
+
+rule
+
+  target: exps
+        ;
+
+  exps  : /* none */ { result = [] }
+        | exps exp ';' { result = val[0].push(val[1]) }
+        | exps error ';' { result = val[0].push(:error) }
+        ;
+
+  exp   : exp '*' exp { result = val[0] * val[2] }
+        | exp '+' exp { result = val[0] + val[2] }
+        | NUM
+        ;
+
+end
+
+---- inner
+
+  def initialize(base)
+    @base = base
+  end
+
+  def self.scan(str)
+    str.scan(/\d+|\S/) do |s|
+      if /\d/ =~ s
+        yield :NUM, s.to_i
+      else
+        yield s, s
+      end
+    end
+  end
+
+  def on_error(t, val, vstack)
+  end
+
+---- footer
+
+chunks = ['1 + 2', ' * 3; 4 ', '5;', ' 6 *', ' 7;']
+parser = PushCalc.push_parser(10)
+raise 'parser not created' unless parser.parser.instance_variable_get(:@base) == 10
+chunks.each do |chunk|
+  PushCalc.scan(chunk) {|tok, val| parser.push(tok, val) }
+  raise 'finished too early' if parser.finished?
+  raise 'result too early' if parser.result
+end
+result = parser.finish
+raise "wrong result: #{result.inspect}" unless result == [7, :error, 42]
+raise 'not finished' unless parser.finished?
+raise 'wrong result' unless parser.result == result
+
+begin
+  parser.push :NUM, 1
+  raise 'token accepted after the end'
+rescue ArgumentError
+end
+
+parser = PushCalc.new(0).push_parser
+raise "wrong result" unless parser.finish == []
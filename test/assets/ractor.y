@@ -0,0 +1,51 @@
+#
+# parsers used from Ractors other than the main one
+#
+
+class RactorParser
+
+  prechigh
+    left '*'
+    left '+'
+  preclow
+
+rule
+
+  target: expr
+        ;
+
+  expr  : NUM
+        | '(' expr ')'     { result = val[1] }
+        | expr '+' expr    { result = val[0] + val[2] }
+        | expr '*' expr    { result = val[0] * val[2] }
+        ;
+
+end
+
+---- inner
+
+  def parse(str)
+    @q = str.scan(/\d+|\S/).map {|s| /\d/ =~ s ? [:NUM, s.to_i] : [s, s] }
+    do_parse
+  end
+
+  def next_token
+    @q.shift || [false, '$']
+  end
+
+---- footer
+
+if defined?(Ractor)
+  Warning[:experimental] = false
+
+  # The tables are first used from another Ractor, then from the main one.
+  r = Ractor.new { RactorParser.new.parse('1 + 2 * 3') }
+  raise "wrong result in a Ractor" unless r.take == 7
+  raise "wrong result" unless RactorParser.new.parse('(1 + 2) * 3') == 9
+  rs = 4.times.map {|i|
+    Ractor.new(i) {|n| 10.times.map { RactorParser.new.parse("#{n} * 2 + 1") } }
+  }
+  rs.each_with_index do |ractor, i|
+    raise "wrong result in a Ractor" unless ractor.take == [i * 2 + 1] * 10
+  end
+end
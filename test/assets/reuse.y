@@ -0,0 +1,53 @@
+#
+# parsing many inputs with one parser object
+#
+
+class Reuse
+
+  options native_stack
+
+rule
+
+  target: list
+        ;
+
+  list  : /* none */ { result = [] }
+        | item list { result = val[1].unshift(val[0]) }
+        ;
+
+  item  : NUM
+        ;
+
+end
+
+---- inner
+
+  def parse(str)
+    @q = str.scan(/\d+|\S/).map {|s|
+      /\d/ =~ s ? [:NUM, s.to_i] : [s, s]
+    }
+    @q.push [false, '$']
+    do_parse
+  end
+
+  def next_token
+    @q.shift
+  end
+
+---- footer
+
+parser = Reuse.new
+1000.times do |i|
+  result = parser.parse("#{i} #{i + 1}")
+  raise "wrong result: #{result.inspect}" unless result == [i, i + 1]
+end
+
+big = (1..10000).to_a
+raise 'wrong result' unless parser.parse(big.join(' ')) == big
+
+begin
+  parser.parse("1 x")
+  raise 'parse error not detected'
+rescue Racc::ParseError
+end
+raise 'wrong result after error' unless parser.parse('5') == [5]
@@ -0,0 +1,120 @@
+#
+# the parse loop generated by the ruby_parse_loop option
+#
+
+class RubyParseLoop
+
+  options ruby_parse_loop
+
+  prechigh
+    left '*'
+    left '+'
+  preclow
+
+rule
+
+  target: stmts
+        ;
+
+  stmts : /* none */       { result = [] }
+        | stmts stmt       { result = val[0].push(val[1]) }
+        ;
+
+  stmt  : expr ';'
+        | error ';'        { result = :error }
+        | '!' ';'          { yyerror }
+        | '.'              { yyaccept }
+        ;
+
+  expr  : NUM
+        | '(' expr ')'     { result = val[1] }
+        | expr '+' expr    { result = val[0] + val[2] }
+        | expr '*' expr    { result = val[0] * val[2] }
+        ;
+
+end
+
+---- inner
+
+  attr_reader :errors, :evalacts
+
+  def tokens(str)
+    str.scan(/\d+|\S/).map {|s| /\d/ =~ s ? [:NUM, s.to_i] : [s, s] }
+  end
+
+  def parse(str, how)
+    @errors = []
+    @evalacts = 0
+    @q = tokens(str)
+    # The loop replaces the one of the Ruby runtime, whichever runs.
+    case how
+    when :loop
+      _racc_do_parse_rb(_racc_setup, false)
+    when :tokens
+      _racc_do_parse_tokens_rb(_racc_setup, @q.map(&:first), @q.map(&:last), false)
+    when :generic
+      Racc::Parser.instance_method(:_racc_do_parse_rb).bind(self).call(_racc_setup, false)
+    end
+  end
+
+  def next_token
+    @q.shift || [false, '$']
+  end
+
+  def on_error(t, val, vstack)
+    @errors.push [token_to_str(t), val]
+  end
+
+  def _racc_evalact(act, arg)
+    @evalacts += 1
+    super
+  end
+
+---- footer
+
+def parse(src, how)
+  parser = RubyParseLoop.new
+  [parser.parse(src, how), parser.errors, parser.evalacts]
+end
+
+[
+  '1 + 2 * 3; (6 + 7) * 8;',
+  '',
+  '1 + ; 2;',
+  '1; ! ; 2; 3;',
+  '1; . 3;',
+  '1 2',
+  '(1',
+  '1; 2 3 4; (5; 6;'
+].each do |src|
+  expected, errors, = parse(src, :generic)
+  [:loop, :tokens].each do |how|
+    result = parse(src, how)
+    unless result[0, 2] == [expected, errors]
+      raise "#{how}: #{src.inspect}: #{result.inspect} != #{[expected, errors].inspect}"
+    end
+  end
+end
+
+# Only accepting and error recovery go through the generic _racc_evalact.
+result, errors, evalacts = parse('1 + 2 * 3; (6 + 7) * 8;', :loop)
+raise "wrong result: #{result.inspect}" unless result == [7, 104]
+raise "wrong errors: #{errors.inspect}" unless errors.empty?
+raise "generic loop used: #{evalacts}" unless evalacts == 1
+
+result, errors, = parse('1 + ; 2;', :loop)
+raise "wrong result: #{result.inspect}" unless result == [:error]
+raise "wrong errors: #{errors.inspect}" unless errors == [['";"', ';']]
+
+result, = parse('1; ! ; 2; 3;', :loop)
+raise "wrong result: #{result.inspect}" unless result == [1, :error, 3]
+
+result, = parse('1; . 3;', :loop)
+raise "wrong result: #{result.inspect}" unless result == [1]
+
+# Statistics are left to the generic loop.
+parser = RubyParseLoop.new
+parser.racc_collect_statistics = true
+parser.parse('1 + 2;', :loop)
+raise 'no statistics' unless parser.racc_statistics[:tokens] == 4
+raise 'generic loop not used' unless parser.evalacts > 1
@@ -0,0 +1,67 @@
+#
+# states with the same actions sharing one row of the action table
+#
+
+class ShareActionRows
+
+  options share_action_rows
+
+  prechigh
+    left '*' '/'
+    left '+' '-'
+  preclow
+
+rule
+
+  target: stmts
+        ;
+
+  stmts : /* none */     { result = [] }
+        | stmts stmt     { result = val[0].push(val[1]) }
+        ;
+
+  stmt  : expr ';'
+        | error ';'      { result = :error }
+        ;
+
+  expr  : NUM
+        | '(' expr ')'   { result = val[1] }
+        | expr '+' expr  { result = val[0] + val[2] }
+        | expr '-' expr  { result = val[0] - val[2] }
+        | expr '*' expr  { result = val[0] * val[2] }
+        | expr '/' expr  { result = val[0] / val[2] }
+        ;
+
+end
+
+---- inner
+
+  def parse(str)
+    @q = str.scan(/\d+|\S/).map {|s|
+      /\d/ =~ s ? [:NUM, s.to_i] : [s, s]
+    }
+    @q.push [false, '$']
+    do_parse
+  end
+
+  def next_token
+    @q.shift
+  end
+
+  def on_error(*)
+  end
+
+---- footer
+
+ptr = ShareActionRows::Racc_arg[3].compact
+raise 'no row is shared' unless ptr.uniq.size < ptr.size
+
+{
+  '1 + 2 * 3;'          => [7],
+  '(1 + 2) * 3; 8 / 2;' => [9, 4],
+  '1 1; 2; 3;'          => [:error, 2, 3],
+  '(1 2); 4;'           => [:error, 4],
+}.each do |src, expected|
+  result = ShareActionRows.new.parse(src)
+  raise "#{src}: wrong result: #{result.inspect}" unless result == expected
+end
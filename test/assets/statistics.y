@@ -0,0 +1,131 @@
+#
+# parse statistics of the C and Ruby runtimes
+#
+
+class Statistics
+
+  prechigh
+    left '*'
+    left '+'
+  preclow
+
+rule
+
+  target: stmts
+        ;
+
+  stmts : /* none */     { result = [] }
+        | stmts stmt     { result = val[0].push(val[1]) }
+        ;
+
+  stmt  : expr ';'
+        | error ';'      { result = :error }
+        ;
+
+  expr  : NUM
+        | '(' expr ')'   { result = val[1] }
+        | expr '+' expr  { result = val[0] + val[2] }
+        | expr '*' expr  { result = val[0] * val[2] }
+        ;
+
+end
+
+---- inner
+
+  def initialize(raise_error = false)
+    @raise_error = raise_error
+  end
+
+  def tokens(str)
+    str.scan(/\d+|\S/).map {|s| /\d/ =~ s ? [:NUM, s.to_i] : [s, s] }
+  end
+
+  def parse(str, how, ruby_core = false)
+    @q = tokens(str).push([false, '$'])
+    case how
+    when :do_parse
+      if ruby_core
+        _racc_do_parse_rb(_racc_setup, false)
+      else
+        do_parse
+      end
+    when :yyparse
+      if ruby_core
+        _racc_yyparse_rb(@q, :each, _racc_setup, false)
+      else
+        yyparse(@q, :each)
+      end
+    when :push
+      pp = push_parser
+      tokens(str).each {|tok, val| pp.push tok, val }
+      pp.finish
+    end
+  end
+
+  def next_token
+    @q.shift
+  end
+
+  def on_error(*)
+    raise ParseError, 'error' if @raise_error
+  end
+
+---- footer
+
+EXPR_PLUS = 8   # rule number of expr : expr '+' expr
+EXPR_NUM = 6    # rule number of expr : NUM
+
+parser = Statistics.new
+parser.parse('1;', :do_parse)
+raise 'statistics without racc_collect_statistics' unless parser.racc_statistics.nil?
+
+def statistics(src, how, ruby_core)
+  parser = Statistics.new
+  parser.racc_collect_statistics = true
+  parser.parse(src, how, ruby_core)
+  parser.racc_statistics
+end
+
+src = '1 + 2 * 3; (6 + 7) + 8;'
+expected = statistics(src, :do_parse, false)
+[:do_parse, :yyparse, :push].each do |how|
+  [false, true].each do |ruby_core|
+    next if how == :push and ruby_core
+    stats = statistics(src, how, ruby_core)
+    raise "#{how}: differs: #{stats.inspect}" unless stats == expected
+  end
+end
+raise "wrong tokens: #{expected[:tokens]}" unless expected[:tokens] == 14
+raise 'wrong reductions' unless expected[:reductions][EXPR_PLUS] == 3
+raise 'wrong reductions' unless expected[:reductions][EXPR_NUM] == 6
+raise 'wrong states' unless expected[:states][0] == 1
+unless expected[:states].sum == expected[:shifts] + expected[:reductions].sum + 1
+  raise 'wrong states'
+end
+raise 'wrong max_depth' unless expected[:max_depth] >= 6
+raise 'wrong errors' unless expected[:errors] == 0
+
+# The runtimes recover from errors by different steps, but read the same.
+[false, true].each do |ruby_core|
+  stats = statistics('1 + 2; 3 4 5; 6;', :do_parse, ruby_core)
+  raise "wrong tokens: #{stats[:tokens]}" unless stats[:tokens] == 10
+  raise "wrong errors: #{stats[:errors]}" unless stats[:errors] == 1
+  raise 'wrong reductions' unless stats[:reductions][EXPR_NUM] == 4
+end
+
+# The counts are kept when the parse ends by an exception.
+[false, true].each do |ruby_core|
+  parser = Statistics.new(true)
+  parser.racc_collect_statistics = true
+  begin
+    parser.parse('1 + 2; 3 4;', :do_parse, ruby_core)
+    raise 'no ParseError'
+  rescue ParseError
+  end
+  raise 'no statistics after an error' unless parser.racc_statistics[:errors] == 1
+  raise 'wrong tokens after an error' unless parser.racc_statistics[:tokens] == 6
+
+  parser.racc_collect_statistics = false
+  parser.parse('1;', :do_parse, ruby_core)
+  raise 'statistics are not cleared' unless parser.racc_statistics.nil?
+end
@@ -0,0 +1,53 @@
+#
+# Parser#do_parse_tokens test
+#
+
+class TokenBuffer
+
+  options token_constants
+
+  prechigh
+    left '*'
+    left PLUS
+  preclow
+
+rule
+
+  target: exp
+        | /* none */ { result = 0 }
+        ;
+
+  exp   : exp '*' exp { result = val[0] * val[2] }
+        | exp PLUS exp { result = val[0] + val[2] }
+        | NUM
+        ;
+
+end
+
+---- inner
+
+  def next_token
+    raise 'next_token called'
+  end
+
+---- footer
+
+include TokenBuffer::Tokens
+
+types  = [NUM, :PLUS, NUM, '*', :NUM]
+values = [2, '+', 3, '*', 4]
+result = TokenBuffer.new.do_parse_tokens(types, values)
+raise "wrong result: #{result}" unless result == 14
+
+types  = [NUM, PLUS, NUM, PLUS, NUM].pack('l*')
+result = TokenBuffer.new.do_parse_tokens(types, [1, '+', 2, '+', 3])
+raise "wrong result: #{result}" unless result == 6
+
+result = TokenBuffer.new.do_parse_tokens([], [])
+raise "wrong result: #{result}" unless result == 0
+
+begin
+  TokenBuffer.new.do_parse_tokens([NUM, NUM], [1, 2])
+  raise 'parse error not detected'
+rescue Racc::ParseError
+end
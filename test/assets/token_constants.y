@@ -0,0 +1,73 @@
+#
+# options token_constants test
+#
+
+class TokenConstants
+
+  options token_constants
+
+  prechigh
+    left '*'
+    left PLUS
+  preclow
+
+rule
+
+  target: exp
+        | /* none */ { result = 0 }
+        ;
+
+  exp   : exp '*' exp { result = val[0] * val[2] }
+        | exp PLUS exp { result = val[0] + val[2] }
+        | NUM
+        ;
+
+end
+
+---- inner
+
+  def parse(src)
+    @q = src
+    do_parse
+  end
+
+  def next_token
+    @q.shift
+  end
+
+  def parse_yy(src)
+    @q = src
+    yyparse self, :scan
+  end
+
+  def scan
+    @q.each do |tok|
+      yield tok
+    end
+  end
+
+---- footer
+
+include TokenConstants::Tokens
+
+raise 'wrong constant' unless TokenConstants::Tokens.constants.sort == [:NUM, :PLUS]
+
+src = [[NUM, 2], [PLUS, '+'], [NUM, 3], ['*', '*'], [:NUM, 4], [false, '$']]
+
+# The JRuby runtime refuses the parser rather than misread the ids.
+if RUBY_ENGINE == 'jruby' and Racc::Parser.racc_runtime_type == 'c'
+  begin
+    TokenConstants.new.parse(src.dup)
+    raise 'token_constants accepted by the JRuby runtime'
+  rescue NotImplementedError
+  end
+  exit
+end
+raise 'do_parse failed' unless TokenConstants.new.parse(src.dup) == 14
+raise 'yyparse failed' unless TokenConstants.new.parse_yy(src) == 14
+
+begin
+  TokenConstants.new.parse([[NUM, 2], [100, '+'], [false, '$']])
+  raise 'out of range token accepted'
+rescue Racc::ParseError
+end
@@ -0,0 +1,126 @@
+#
+# ring buffer trace of the C and Ruby runtimes
+#
+
+class Trace
+
+  prechigh
+    left '*'
+    left '+'
+  preclow
+
+rule
+
+  target: stmts
+        ;
+
+  stmts : /* none */     { result = [] }
+        | stmts stmt     { result = val[0].push(val[1]) }
+        ;
+
+  stmt  : expr ';'
+        | error ';'      { result = :error }
+        ;
+
+  expr  : NUM
+        | '(' expr ')'   { result = val[1] }
+        | expr '+' expr  { result = val[0] + val[2] }
+        | expr '*' expr  { result = val[0] * val[2] }
+        ;
+
+end
+
+---- inner
+
+  def initialize(raise_error = false)
+    @raise_error = raise_error
+  end
+
+  def tokens(str)
+    str.scan(/\d+|\S/).map {|s| /\d/ =~ s ? [:NUM, s.to_i] : [s, s] }
+  end
+
+  def parse(str, how, ruby_core = false)
+    @q = tokens(str).push([false, '$'])
+    case how
+    when :do_parse
+      if ruby_core
+        _racc_do_parse_rb(_racc_setup, false)
+      else
+        do_parse
+      end
+    when :yyparse
+      if ruby_core
+        _racc_yyparse_rb(@q, :each, _racc_setup, false)
+      else
+        yyparse(@q, :each)
+      end
+    when :push
+      pp = push_parser
+      tokens(str).each {|tok, val| pp.push tok, val }
+      pp.finish
+    end
+  end
+
+  def next_token
+    @q.shift
+  end
+
+  def on_error(*)
+    raise ParseError, 'error' if @raise_error
+  end
+
+---- footer
+
+require 'stringio'
+
+def trace(src, how, ruby_core, size, raise_error = false)
+  parser = Trace.new(raise_error)
+  parser.racc_trace_size = size
+  begin
+    parser.parse(src, how, ruby_core)
+  rescue ParseError
+  end
+  parser.racc_trace
+end
+
+parser = Trace.new
+parser.parse('1;', :do_parse)
+raise 'trace without racc_trace_size' unless parser.racc_trace.nil?
+
+src = '1 + 2 * 3; (6 + 7) + 8;'
+full = trace(src, :do_parse, false, 1000)
+[:do_parse, :yyparse, :push].each do |how|
+  [false, true].each do |ruby_core|
+    next if how == :push and ruby_core
+    t = trace(src, how, ruby_core, 1000)
+    raise "#{how}: differs: #{t.to_a.inspect}" unless t.data == full.data
+  end
+end
+raise "wrong count: #{full.count}" unless full.count == full.size
+events = full.to_a
+raise 'wrong last event' unless events[-1].kind == Racc::ParseTrace::ACCEPT
+reads = events.select {|e| e.kind == Racc::ParseTrace::READ }
+raise "wrong reads: #{reads.size}" unless reads.size == 15   # with $end
+plus = events.count {|e| e.kind == Racc::ParseTrace::REDUCE and e.rule == 8 }
+raise "wrong reductions: #{plus}" unless plus == 3
+text = full.dump(StringIO.new).string
+raise "wrong dump: #{text}" unless text.include?('reduce  expr (rule 8)')
+raise "wrong dump: #{text}" unless text.lines[1].start_with?('read    NUM')
+
+# Only the last events are kept.
+[false, true].each do |ruby_core|
+  t = trace(src, :do_parse, ruby_core, 7)
+  raise "wrong size: #{t.size}" unless t.size == 7
+  raise "wrong count: #{t.count}" unless t.count == full.count
+  raise 'wrong events kept' unless t.to_a == events.last(7)
+  raise 'no note of dropped events' unless t.dump(StringIO.new).string.start_with?('(')
+end
+
+# The events up to an exception are kept.
+[false, true].each do |ruby_core|
+  t = trace('1 + 2; 3 4;', :do_parse, ruby_core, 100, true)
+  last = t.to_a.last
+  raise "wrong last event: #{last.inspect}" unless last.kind == Racc::ParseTrace::ERROR
+  raise "wrong error token: #{last.token}" unless Trace::Racc_token_to_s_table[last.token] == 'NUM'
+end
@@ -0,0 +1,76 @@
+#
+# a layered expression grammar with the unit rules skipped
+#
+
+class UnitRules
+
+  options skip_unit_rules
+
+rule
+
+  target: stmt
+        ;
+
+  stmt  : expr
+        | ID '=' stmt    { result = [:asgn, val[0], val[2]] }
+        ;
+
+  expr  : term
+        | expr '+' term  { result = val[0] + val[2] }
+        | expr '-' term  { result = val[0] - val[2] }
+        ;
+
+  term  : unary
+        | term '*' unary { result = val[0] * val[2] }
+        | term '/' unary { result = val[0] / val[2] }
+        ;
+
+  unary : prim
+        | '-' unary      { result = -val[1] }
+        ;
+
+  prim  : num
+        | '(' expr ')'   { result = val[1] }
+        ;
+
+  num   : NUM            { result = val[0] }
+        ;
+
+end
+
+---- inner
+
+  def parse(str)
+    @q = str.scan(/\d+|\w+|\S/).map {|s|
+      case s
+      when /\A\d/ then [:NUM, s.to_i]
+      when /\A\w/ then [:ID, s]
+      else [s, s]
+      end
+    }
+    @q.push [false, '$']
+    do_parse
+  end
+
+  def next_token
+    @q.shift
+  end
+
+---- footer
+
+{
+  '1'                   => 1,
+  '1 + 2 * 3'           => 7,
+  '(1 + 2) * 3'         => 9,
+  '-(4 - 6) / 2'        => 1,
+  'x = y = 2 * -3'      => [:asgn, 'x', [:asgn, 'y', -6]],
+}.each do |src, expected|
+  result = UnitRules.new.parse(src)
+  raise "#{src}: wrong result: #{result.inspect}" unless result == expected
+end
+
+begin
+  UnitRules.new.parse('1 + * 2')
+  raise 'parse error not detected'
+rescue Racc::ParseError
+end
@@ -0,0 +1,39 @@
+#
+# yyerror called from a method in the inner code, not from the action
+#
+
+class A
+rule
+
+target: a b
+
+a: { error_helper }
+ | error { @recovered = true }
+
+b: { result = :b }
+
+end
+
+---- inner
+
+  def parse
+    do_parse
+    raise ArgumentError, "yyerror failed" unless @recovered
+  end
+
+  def next_token
+    [false, '$end']
+  end
+
+  def error_helper
+    yyerror
+    raise ArgumentError, "yyerror failed"
+  end
+
+  def on_error( *args )
+    $stderr.puts "on_error called: args=#{args.inspect}"
+  end
+
+---- footer
+
+A.new.parse
@@ -0,0 +1,44 @@
+#
+# yyerror called from a method of a module defined in another file
+#
+
+class YyerrModule
+rule
+
+  stmts : /* none */
+        | stmts stmt
+        ;
+
+  stmt  : NUM ';' { @values.push check(val[0]) }
+        | error ';' { @values.push :recovered }
+        ;
+
+end
+
+---- inner
+
+  include YyerrHelpers
+
+  def parse(str, how)
+    @values = []
+    @q = str.scan(/\d+|\S/).map {|s| /\d/ =~ s ? [:NUM, s.to_i] : [s, s] }
+    case how
+    when :parse then do_parse
+    when :ruby  then _racc_do_parse_rb(_racc_setup, false)
+    end
+    @values
+  end
+
+  def next_token
+    @q.shift || [false, '$']
+  end
+
+  def on_error(*)
+  end
+
+---- footer
+
+[:parse, :ruby].each do |how|
+  result = YyerrModule.new.parse('1; 0; 2; 3;', how)
+  raise "#{how}: wrong result: #{result.inspect}" unless result == [1, :recovered, 3]
+end
@@ -80,6 +80,21 @@ module Racc
       ruby "-I#{LIB_DIR}", "-rracc/parser", "#{@TAB_DIR}/#{file}", **opts
     end
 
+    # Checks that the parser refuses to load on a runtime without CONST.
+    def assert_old_runtime_refused(asset, const)
+      file = File.basename(asset, '.y')
+      ruby "-I#{LIB_DIR}", "-rracc/parser", '-e', <<~End, "#{@TAB_DIR}/#{file}"
+        Racc::Parser.send(:remove_const, :#{const})
+        begin
+          load ARGV[0]
+        rescue LoadError => e
+          exit if /needs a newer Racc runtime/ =~ e.message
+          raise
+        end
+        abort 'loaded on an old runtime'
+      End
+    end
+
     def strip_version(source)
       source.sub(/This file is automatically generated by Racc \d+\.\d+\.\d+(?:\.\S+)?/, '')
     end
@@ -94,6 +94,27 @@ eom
     end
   end
 
+  def test_digraph_long_chain
+    n = 100_000
+    relation = Array.new(n) {|i| [i + 1] }
+    relation[-1] = [n / 2]
+    states = Racc::States.new(Racc::Grammar.new)
+    [:digraph, :digraph_rb].each do |m|
+      map = Array.new(n) {|i| 1 << (i % 100) }
+      states.__send__(m, map, relation)
+      assert_equal [2 ** 100 - 1], map.uniq, m
+    end
+  end
+
+  def test_closure_after_release
+    file = File.join(__dir__, 'assets', 'ruby22.y')
+    grammar = Racc::GrammarFileParser.new.parse(File.read(file), file).grammar
+    states = grammar.states
+    closures = states.map {|s| s.closure.map(&:ident) }
+    states.state_transition_table
+    assert_equal closures, states.map {|s| s.closure.map(&:ident) }
+  end
+
   def test_group_or_many
     with_parser("stmt: ('a' | 'b')*") do |parser|
       assert_equal [], parser.parse("")
@@ -84,6 +84,31 @@ module Racc
       assert_compile 'yyerr.y'
       assert_debugfile 'yyerr.y', []
       assert_exec 'yyerr.y'
+
+      assert_compile 'yyerr.y', '--direct-action-calls'
+      assert_exec 'yyerr.y'
+    end
+
+    def test_yyerr_helper_y
+      assert_compile 'yyerr_helper.y'
+      assert_debugfile 'yyerr_helper.y', []
+      assert_exec 'yyerr_helper.y'
+    end
+
+    def test_yyerr_module_y
+      File.write File.join(@TEMP_DIR, 'yyerr_helpers.rb'), <<~End
+        module YyerrHelpers
+          def check(n)
+            yyerror if n == 0
+            n
+          end
+        end
+      End
+      assert_compile 'yyerr_module.y'
+      assert_debugfile 'yyerr_module.y', []
+      ruby "-I#{LIB_DIR}", "-I#{@TEMP_DIR}", '-ryyerr_helpers', "#{@TAB_DIR}/yyerr_module"
+      assert_compile 'yyerr_module.y', '--ruby-parse-loop'
+      ruby "-I#{LIB_DIR}", "-I#{@TEMP_DIR}", '-ryyerr_helpers', "#{@TAB_DIR}/yyerr_module"
     end
 
     def test_recv_y
@@ -136,6 +161,184 @@ module Racc
       assert_exec 'nonass.y'
     end
 
+    def test_native_stack_y
+      assert_compile 'native_stack.y'
+      assert_debugfile 'native_stack.y', []
+      assert_exec 'native_stack.y'
+    end
+
+    def test_positional_args_y
+      assert_compile 'positional_args.y'
+      assert_debugfile 'positional_args.y', []
+      assert_exec 'positional_args.y'
+      assert_old_runtime_refused 'positional_args.y', :Racc_Positional_Args_Core
+    end
+
+    def test_positional_actions_y
+      assert_compile 'positional_actions.y'
+      assert_debugfile 'positional_actions.y', []
+      assert_exec 'positional_actions.y'
+    end
+
+    def test_token_constants_y
+      assert_compile 'token_constants.y'
+      assert_debugfile 'token_constants.y', []
+      assert_exec 'token_constants.y'
+    end
+
+    def test_token_buffer_y
+      assert_compile 'token_buffer.y'
+      assert_debugfile 'token_buffer.y', []
+      assert_exec 'token_buffer.y'
+    end
+
+    def test_push_parser_y
+      assert_compile 'push_parser.y'
+      assert_debugfile 'push_parser.y', []
+      assert_exec 'push_parser.y'
+    end
+
+    def test_reuse_y
+      assert_compile 'reuse.y'
+      assert_debugfile 'reuse.y', []
+      assert_exec 'reuse.y'
+    end
+
+    def test_builtin_actions_y
+      assert_compile 'builtin_actions.y'
+      assert_debugfile 'builtin_actions.y', []
+      assert_exec 'builtin_actions.y'
+    end
+
+    def test_unit_rules_y
+      assert_compile 'unit_rules.y'
+      assert_debugfile 'unit_rules.y', []
+      assert_exec 'unit_rules.y'
+    end
+
+    def test_default_reduction_y
+      assert_compile 'default_reduction.y'
+      assert_debugfile 'default_reduction.y', []
+      assert_exec 'default_reduction.y'
+    end
+
+    def test_share_action_rows_y
+      assert_compile 'share_action_rows.y'
+      assert_debugfile 'share_action_rows.y', []
+      assert_exec 'share_action_rows.y'
+      assert_old_runtime_refused 'share_action_rows.y', :Racc_Shared_Action_Rows_Core
+    end
+
+    def test_packed_tables_y
+      assert_compile 'packed_tables.y'
+      assert_debugfile 'packed_tables.y', []
+      assert_exec 'packed_tables.y'
+    end
+
+    def test_statistics_y
+      assert_compile 'statistics.y'
+      assert_debugfile 'statistics.y', []
+      assert_exec 'statistics.y'
+    end
+
+    def test_trace_y
+      assert_compile 'trace.y'
+      assert_debugfile 'trace.y', []
+      assert_exec 'trace.y'
+    end
+
+    def test_ruby_parse_loop_y
+      assert_compile 'ruby_parse_loop.y'
+      assert_debugfile 'ruby_parse_loop.y', []
+      assert_exec 'ruby_parse_loop.y'
+      assert_compile 'ruby_parse_loop.y', ['--positional-args', '--share-action-rows']
+      assert_exec 'ruby_parse_loop.y'
+      assert_compile 'ruby_parse_loop.y', '--direct-action-calls'
+      assert_exec 'ruby_parse_loop.y'
+    end
+
+    def test_ractor_y
+      assert_compile 'ractor.y'
+      assert_debugfile 'ractor.y', []
+      assert_exec 'ractor.y'
+      assert_compile 'ractor.y', '--packed-tables'
+      assert_exec 'ractor.y'
+      # The Ruby runtime unpacks the tables.
+      ruby "-I#{LIB_DIR}", '-e', 'Racc_No_Extensions = true; load ARGV[0]', "#{@TAB_DIR}/ractor"
+    end
+
+    def test_cache_dir
+      src = File.read("#{ASSET_DIR}/chk.y")
+      cache = File.join(@TEMP_DIR, 'cache')
+      File.write File.join(@TEMP_DIR, 'a.y'), src
+      racc '--cache-dir=cache', '-oa.rb', 'a.y'
+      entries = Dir.children(cache)
+      assert_equal 1, entries.size
+      ino = File.stat(File.join(cache, entries[0])).ino
+
+      # Only an action changes: the table is taken from the cache.
+      File.write File.join(@TEMP_DIR, 'b.y'), src.sub('result *= val[2]', 'result = val[0] * val[2]')
+      racc '--cache-dir=cache', '-ob.rb', 'b.y'
+      assert_equal entries, Dir.children(cache)
+      assert_equal ino, File.stat(File.join(cache, entries[0])).ino
+      ruby "-I#{LIB_DIR}", 'b.rb'
+      racc '-oc.rb', 'b.y'
+      assert_equal File.read(File.join(@TEMP_DIR, 'c.rb')),
+                   File.read(File.join(@TEMP_DIR, 'b.rb'))
+
+      # The precedence changes: the table is computed again.
+      File.write File.join(@TEMP_DIR, 'c.y'), src.sub("left '+' '-'", "right '+' '-'")
+      racc '--cache-dir=cache', '-oc.rb', 'c.y'
+      assert_equal 2, Dir.children(cache).size
+    end
+
+    def test_c_extension
+      omit 'needs MRI to build the extension' unless RUBY_ENGINE == 'ruby'
+      make = ENV['MAKE'] || 'make'
+      omit 'needs make' unless system(make, '--version', out: File::NULL, err: File::NULL)
+      FileUtils.cp "#{ASSET_DIR}/chk.y", @TEMP_DIR
+      racc '--c-extension=ext', '-ochk.rb', 'chk.y'
+      ext = File.join(@TEMP_DIR, 'ext')
+      assert_path_exist File.join(ext, 'chk_tables.c')
+      assert_path_exist File.join(ext, 'extconf.rb')
+      ruby '-Cext', 'extconf.rb'
+      assert system(make, chdir: ext, out: File::NULL)
+      ruby "-I#{LIB_DIR}", '-Iext', 'chk.rb'
+
+      # Both runtimes take the tables from other Ractors too.
+      FileUtils.cp "#{ASSET_DIR}/ractor.y", @TEMP_DIR
+      racc '--c-extension=ext2', '-oractor.rb', 'ractor.y'
+      ruby '-Cext2', 'extconf.rb'
+      assert system(make, chdir: File.join(@TEMP_DIR, 'ext2'), out: File::NULL)
+      if defined?(Ractor)
+        # The extension is marked Ractor-safe and may be required in one.
+        assert_match(/-DHAVE_RB_EXT_RACTOR_SAFE\b/, File.read(File.join(@TEMP_DIR, 'ext2', 'Makefile')))
+        ruby '--disable-gems', '-Iext2', '-e', <<~'RUBY'
+          Warning[:experimental] = false
+          r = Ractor.new { require 'ractor_tables'; Racc::CTables::RactorTables::RACC_ACTION_TABLE }
+          abort 'tables not shareable' unless Ractor.shareable?(r.take)
+        RUBY
+      end
+      ruby "-I#{LIB_DIR}", '-Iext2', 'ractor.rb'
+      ruby "-I#{LIB_DIR}", '-Iext2', '-e', 'Racc_No_Extensions = true; load ARGV[0]', 'ractor.rb'
+    end
+
+    def test_sentence
+      racc '--sentence=100', '--seed=1', "-o#{@OUT_DIR}/chk.sentence", "#{ASSET_DIR}/chk.y"
+      ids = File.binread("#{@OUT_DIR}/chk.sentence").unpack('l*')
+      assert_not_empty ids
+      assert_operator ids.size, :<=, 100
+    end
+
+    def test_several_inputs
+      files = %w[chk opt echk]
+      files.each {|f| FileUtils.cp "#{ASSET_DIR}/#{f}.y", @TEMP_DIR }
+      racc '-j2', *files.map {|f| "#{f}.y" }
+      files.each do |f|
+        ruby "-I#{LIB_DIR}", "#{f}.tab.rb"
+      end
+    end
+
     def test_digraph_y
       assert_compile 'digraph.y'
       assert_debugfile 'digraph.y', []
@@ -0,0 +1,43 @@
+require File.expand_path(File.join(__dir__, 'case'))
+
+module Racc
+  class TestSentenceGenerator < TestCase
+    def grammar(asset)
+      path = File.join(ASSET_DIR, asset)
+      GrammarFileParser.new.parse(File.read(path), asset).grammar
+    end
+
+    def test_sentences_are_accepted
+      %w[chk.y intp.y ruby22.y nokogiri-css.y].each do |asset|
+        g = grammar(asset)
+        parser = SentenceGenerator.recognizer(States.new(g).nfa)
+        gen = SentenceGenerator.new(g, random: Random.new(1))
+        [0, 10, 1000].each do |length|
+          sentence = gen.generate(length)
+          assert_operator sentence.size, :<=, length + 10, asset
+          assert_nothing_raised(asset) {
+            parser.new.do_parse_tokens(sentence.map(&:ident), [])
+          }
+        end
+      end
+    end
+
+    def test_length
+      gen = SentenceGenerator.new(grammar('ruby22.y'), random: Random.new(2))
+      assert_in_delta 5000, gen.generate(5000).size, 50
+    end
+
+    def test_seed
+      g = grammar('chk.y')
+      a = SentenceGenerator.new(g, random: Random.new(3)).generate(100)
+      b = SentenceGenerator.new(g, random: Random.new(3)).generate(100)
+      assert_equal a, b
+    end
+
+    def test_no_sentence
+      assert_raise(CompileError) {
+        SentenceGenerator.new(grammar('error_recovery.y'))
+      }
+    end
+  end
+end